@@ -0,0 +1,161 @@
+/* Response cache for OBD PIDs and UDS DIDs */
+/* Slow-changing signals (SOH, odometer, TPMS) are served from here until their */
+/* TTL expires, so readers such as BLE and the live data API never hit the bus */
+/* for a value the poller read moments ago. */
+
+#include <string.h>
+#include "CAN-cache.h"
+
+bool CResponseCache::put(uint8_t kind, uint32_t canId, uint32_t id, int32_t value, const uint8_t* data, uint16_t len,
+  uint32_t ttl, uint8_t flags, uint32_t now)
+{
+  if (len > CACHE_MAX_DATA) return false;
+  uint8_t count = m_count.load(std::memory_order_relaxed);
+  int index = find(kind, canId, id);
+  if (index < 0) {
+    if (count < CACHE_MAX_ENTRIES) {
+      index = count;
+    } else {
+      // replace the reply read longest ago
+      index = 0;
+      uint32_t oldest = m_slots[0].words[offsetof(Entry, ts) / 4].load(std::memory_order_relaxed);
+      for (uint8_t i = 1; i < count; i++) {
+        uint32_t ts = m_slots[i].words[offsetof(Entry, ts) / 4].load(std::memory_order_relaxed);
+        if ((int32_t)(ts - oldest) < 0) {
+          index = i;
+          oldest = ts;
+        }
+      }
+    }
+  }
+  Entry e;
+  e.kind = kind;
+  e.flags = flags;
+  e.len = len;
+  e.canId = canId;
+  e.id = id;
+  e.ts = now;
+  e.ttl = ttl;
+  e.epoch = m_epoch.load(std::memory_order_relaxed);
+  e.value = value;
+  if (len) memcpy(e.data, data, len);
+  Slot& slot = m_slots[index];
+  uint32_t seq = slot.seq.load(std::memory_order_relaxed);
+  slot.seq.store(seq + 1, std::memory_order_relaxed);
+  store(slot, e);
+  slot.seq.store(seq + 2, std::memory_order_release);
+  if (index == count) m_count.store(count + 1, std::memory_order_release);
+  return true;
+}
+
+bool CResponseCache::get(uint8_t kind, uint32_t canId, uint32_t id, uint32_t now, CacheReply& reply)
+{
+  uint8_t count = this->count();
+  for (uint8_t i = 0; i < count; i++) {
+    Entry e;
+    if (!snapshot(i, e) || e.kind != kind || e.canId != canId || e.id != id) continue;
+    if (!left(e, now)) break;
+    reply.kind = e.kind;
+    reply.canId = e.canId;
+    reply.id = e.id;
+    reply.value = e.value;
+    reply.age = now - e.ts;
+    reply.len = e.len;
+    memcpy(reply.data, e.data, e.len);
+    m_hits.fetch_add(1, std::memory_order_relaxed);
+    return true;
+  }
+  m_misses.fetch_add(1, std::memory_order_relaxed);
+  return false;
+}
+
+uint32_t CResponseCache::remaining(uint8_t kind, uint32_t canId, uint32_t id, uint32_t now) const
+{
+  uint8_t count = this->count();
+  for (uint8_t i = 0; i < count; i++) {
+    Entry e;
+    if (snapshot(i, e) && e.kind == kind && e.canId == canId && e.id == id) return left(e, now);
+  }
+  return 0;
+}
+
+bool CResponseCache::at(uint8_t index, uint32_t now, CacheReply& reply) const
+{
+  if (index >= count()) return false;
+  Entry e;
+  if (!snapshot(index, e) || !left(e, now)) return false;
+  reply.kind = e.kind;
+  reply.canId = e.canId;
+  reply.id = e.id;
+  reply.value = e.value;
+  reply.age = now - e.ts;
+  reply.len = e.len;
+  memcpy(reply.data, e.data, e.len);
+  return true;
+}
+
+void CResponseCache::setIgnition(bool on)
+{
+  if (on == m_ignition) return;
+  m_ignition = on;
+  m_epoch.fetch_add(1, std::memory_order_release);
+}
+
+int CResponseCache::find(uint8_t kind, uint32_t canId, uint32_t id) const
+{
+  uint8_t count = m_count.load(std::memory_order_relaxed);
+  for (uint8_t i = 0; i < count; i++) {
+    // only this task writes the slots, so the header needs no sequence check here
+    Entry e;
+    loadHead(m_slots[i], e, std::memory_order_relaxed);
+    if (e.kind == kind && e.canId == canId && e.id == id) return i;
+  }
+  return -1;
+}
+
+bool CResponseCache::snapshot(uint8_t index, Entry& e) const
+{
+  const Slot& slot = m_slots[index];
+  // bounded, since spinning could starve a preempted writer on the same core
+  for (uint8_t retry = 0; retry < CACHE_READ_RETRIES; retry++) {
+    uint32_t seq = slot.seq.load(std::memory_order_acquire);
+    if (seq & 1) continue;
+    load(slot, e, std::memory_order_acquire);
+    if (slot.seq.load(std::memory_order_relaxed) == seq) return true;
+  }
+  return false;
+}
+
+void CResponseCache::store(Slot& slot, const Entry& e)
+{
+  uint32_t words[ENTRY_WORDS];
+  size_t n = HEAD_WORDS + (e.len + 3) / 4;
+  memcpy(words, &e, n * 4);
+  // release: a reader that sees any new word also sees the odd sequence stored before it
+  for (size_t i = 0; i < n; i++) slot.words[i].store(words[i], std::memory_order_release);
+}
+
+void CResponseCache::loadHead(const Slot& slot, Entry& e, std::memory_order order)
+{
+  uint32_t words[HEAD_WORDS];
+  for (size_t i = 0; i < HEAD_WORDS; i++) words[i] = slot.words[i].load(order);
+  memcpy(&e, words, sizeof(words));
+}
+
+void CResponseCache::load(const Slot& slot, Entry& e, std::memory_order order)
+{
+  loadHead(slot, e, order);
+  // a torn header may carry any length
+  if (e.len > CACHE_MAX_DATA) e.len = CACHE_MAX_DATA;
+  uint32_t words[CACHE_MAX_DATA / 4];
+  size_t n = (e.len + 3) / 4;
+  for (size_t i = 0; i < n; i++) words[i] = slot.words[HEAD_WORDS + i].load(order);
+  memcpy(e.data, words, n * 4);
+}
+
+uint32_t CResponseCache::left(const Entry& e, uint32_t now) const
+{
+  if ((e.flags & CACHE_IGNITION) && e.epoch != m_epoch.load(std::memory_order_acquire)) return 0;
+  uint32_t age = now - e.ts;
+  return age < e.ttl ? e.ttl - age : 0;
+}
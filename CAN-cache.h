@@ -0,0 +1,94 @@
+#ifndef CAN_CACHE_H
+#define CAN_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// number of cached replies (one per OBD PID or UDS DID)
+#define CACHE_MAX_ENTRIES 24
+// reply bytes kept per DID; longer replies are not cached
+#define CACHE_MAX_DATA 96
+// TTL of a reply read on demand for a signal without a poll entry (ms)
+#define CACHE_DEFAULT_TTL 1000
+// attempts to copy a slot while it is being rewritten before a read counts as a miss
+#define CACHE_READ_RETRIES 4
+
+// cache flags
+#define CACHE_IGNITION 0x1  // reply is only valid while the ignition state is unchanged
+
+// copy of one cached reply handed to readers
+struct CacheReply {
+  uint8_t kind;       // POLL_OBD_PID or POLL_UDS_DID
+  uint32_t canId;     // UDS request CAN ID, 0 for OBD PIDs
+  uint32_t id;        // OBD PID or UDS DID
+  int32_t value;      // decoded OBD PID value
+  uint32_t age;       // time since the reply was read (ms)
+  uint16_t len;       // DID reply bytes in data
+  uint8_t data[CACHE_MAX_DATA];
+};
+
+// TTL cache of OBD PID values and UDS DID replies
+// put() and setIgnition() are serialized by the caller (obdLock); get() and at() may run on any
+// task, every slot is guarded by a sequence counter so readers never see a half-written reply
+class CResponseCache {
+public:
+  // stores a reply valid for ttl ms (and, with CACHE_IGNITION, until the ignition state changes);
+  // a new key takes a free slot or replaces the oldest reply
+  bool put(uint8_t kind, uint32_t canId, uint32_t id, int32_t value, const uint8_t* data, uint16_t len,
+    uint32_t ttl, uint8_t flags, uint32_t now);
+  // copies the reply if it is still valid
+  bool get(uint8_t kind, uint32_t canId, uint32_t id, uint32_t now, CacheReply& reply);
+  // time until the reply expires (ms), 0 if it is missing or already expired
+  uint32_t remaining(uint8_t kind, uint32_t canId, uint32_t id, uint32_t now) const;
+  // copies the reply in the given slot if it holds a valid one (for listing the whole cache)
+  bool at(uint8_t index, uint32_t now, CacheReply& reply) const;
+  // invalidates CACHE_IGNITION replies when the ignition state changes
+  void setIgnition(bool on);
+  uint8_t count() const { return m_count.load(std::memory_order_acquire); }
+  uint32_t hits() const { return m_hits.load(std::memory_order_relaxed); }
+  uint32_t misses() const { return m_misses.load(std::memory_order_relaxed); }
+
+private:
+  struct Entry {
+    uint8_t kind;
+    uint8_t flags;
+    uint16_t len;
+    uint32_t canId;
+    uint32_t id;
+    uint32_t ts;      // millis() when the reply was read
+    uint32_t ttl;
+    uint32_t epoch;   // ignition epoch the reply was read in
+    int32_t value;
+    uint8_t data[CACHE_MAX_DATA];
+  };
+  // the entry is kept as atomic words, so a reader racing the writer gets a torn copy that
+  // the sequence check rejects rather than a data race
+  static const size_t ENTRY_WORDS = sizeof(Entry) / 4;
+  static const size_t HEAD_WORDS = offsetof(Entry, data) / 4;
+  static_assert(offsetof(Entry, data) % 4 == 0 && CACHE_MAX_DATA % 4 == 0, "entry must split into words");
+  struct Slot {
+    std::atomic<uint32_t> seq{0};  // odd while the entry is written
+    std::atomic<uint32_t> words[ENTRY_WORDS];
+  };
+  // slot index holding the key, -1 if none (writer side)
+  int find(uint8_t kind, uint32_t canId, uint32_t id) const;
+  // consistent copy of a slot's entry, false if it kept changing
+  bool snapshot(uint8_t index, Entry& e) const;
+  // copies the header and the used part of data into or out of a slot; readers load with
+  // acquire so that any word from a newer put() makes the sequence check fail
+  static void store(Slot& slot, const Entry& e);
+  static void load(const Slot& slot, Entry& e, std::memory_order order);
+  // copies only the header (key, timestamps, length) out of a slot
+  static void loadHead(const Slot& slot, Entry& e, std::memory_order order);
+  // time until the entry expires (ms), 0 if expired
+  uint32_t left(const Entry& e, uint32_t now) const;
+  Slot m_slots[CACHE_MAX_ENTRIES];
+  std::atomic<uint8_t> m_count{0};
+  std::atomic<uint32_t> m_epoch{0};
+  bool m_ignition = false;
+  std::atomic<uint32_t> m_hits{0};
+  std::atomic<uint32_t> m_misses{0};
+};
+
+#endif  // CAN_CACHE_H
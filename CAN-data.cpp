@@ -5,12 +5,106 @@
 #include "abrp.h"
 #include "CAN-data.h"
 
-#include <FreematicsPlus.h>
+namespace {
+// Kia EV9 (E-GMP) signals, byte offsets count from the 0x62 response SID.
+// The E-GMP gateway forwards few broadcasts to the OBD port, so most signals are polled;
+// CAN_SIGNAL_BROADCAST rows are captured in monitor mode and their offsets count from
+// the first data byte of the frame.
+constexpr CanSignal kKiaEv9Signals[] = {
+    // ECU, DID, byte, bit, bits, signed, scale, offset, field, flag, valid
+    // BMS 7E4 220101
+    {0x7E4, 0x220101, 7, 0, 8, false, 0.5f, 0.0f, &AbrpTelemetry::soc, nullptr, &AbrpTelemetry::soc_valid},
+    {0x7E4, 0x220101, 12, 7, 1, false, 1.0f, 0.0f, nullptr, &AbrpTelemetry::is_charging, &AbrpTelemetry::is_charging_valid},
+    {0x7E4, 0x220101, 12, 5, 1, false, 1.0f, 0.0f, nullptr, &AbrpTelemetry::is_dcfc, &AbrpTelemetry::is_dcfc_valid},
+    {0x7E4, 0x220101, 13, 0, 16, true, 0.1f, 0.0f, &AbrpTelemetry::current, nullptr, &AbrpTelemetry::current_valid},
+    {0x7E4, 0x220101, 15, 0, 16, false, 0.1f, 0.0f, &AbrpTelemetry::voltage, nullptr, &AbrpTelemetry::voltage_valid},
+    {0x7E4, 0x220101, 19, 0, 8, true, 1.0f, 0.0f, &AbrpTelemetry::batt_temp, nullptr, &AbrpTelemetry::batt_temp_valid},
+    // BMS 7E4 220105
+    {0x7E4, 0x220105, 28, 0, 16, false, 0.1f, 0.0f, &AbrpTelemetry::soh, nullptr, &AbrpTelemetry::soh_valid},
+    // AIRCON 7B3 220100
+    {0x7B3, 0x220100, 8, 0, 8, false, 0.5f, -40.0f, &AbrpTelemetry::cabin_temp, nullptr, &AbrpTelemetry::cabin_temp_valid},
+    {0x7B3, 0x220100, 9, 0, 8, false, 0.5f, -40.0f, &AbrpTelemetry::ext_temp, nullptr, &AbrpTelemetry::ext_temp_valid},
+    // CLUSTER 7C6 22B002
+    {0x7C6, 0x22B002, 9, 0, 24, false, 1.0f, 0.0f, &AbrpTelemetry::odometer, nullptr, &AbrpTelemetry::odometer_valid},
+    // CLU 4F1 broadcast: displayed vehicle speed
+    {0x4F1, CAN_SIGNAL_BROADCAST, 1, 0, 8, false, 1.0f, 0.0f, &AbrpTelemetry::speed, nullptr, &AbrpTelemetry::speed_valid},
+};
+} // namespace
 
 AbrpTelemetry abrpTelemetry;
 
 void resetAbrpTelemetry(AbrpTelemetry& data)
 {
     data = AbrpTelemetry();
-    // TODO: When CAN decode is implemented, populate abrpTelemetry fields from CAN PIDs here.
+}
+
+// Extracts and scales every matching signal straight from the binary response.
+int decodeCanSignals(const CanSignal* table, size_t count, uint32_t ecu, uint32_t did,
+                     const uint8_t* response, size_t len, AbrpTelemetry& data)
+{
+    int decoded = 0;
+    for (size_t i = 0; i < count; i++) {
+        const CanSignal& sig = table[i];
+        if (sig.ecu != ecu || sig.did != did || sig.bitLength == 0 || sig.bitLength > 32) {
+            continue;
+        }
+        size_t bytes = (sig.bitOffset + sig.bitLength + 7) / 8;
+        if (bytes > 4 || sig.byteOffset + bytes > len) {
+            continue;
+        }
+        uint32_t raw = 0;
+        for (size_t n = 0; n < bytes; n++) {
+            raw = (raw << 8) | response[sig.byteOffset + n];
+        }
+        raw >>= sig.bitOffset;
+        if (sig.bitLength < 32) {
+            raw &= (1UL << sig.bitLength) - 1;
+        }
+        int32_t value = (int32_t)raw;
+        if (sig.isSigned && sig.bitLength < 32 && (raw & (1UL << (sig.bitLength - 1)))) {
+            value = (int32_t)(raw | ~((1UL << sig.bitLength) - 1));
+        }
+        if (sig.field) {
+            data.*(sig.field) = value * sig.scale + sig.offset;
+        } else if (sig.flag) {
+            data.*(sig.flag) = value != 0;
+        } else {
+            continue;
+        }
+        if (sig.valid) {
+            data.*(sig.valid) = true;
+        }
+        decoded++;
+    }
+    return decoded;
+}
+
+int decodeAbrpTelemetry(uint32_t ecu, uint32_t did, const uint8_t* response, size_t len, AbrpTelemetry& data)
+{
+    int decoded = decodeCanSignals(kKiaEv9Signals, sizeof(kKiaEv9Signals) / sizeof(kKiaEv9Signals[0]),
+                                   ecu, did, response, len, data);
+    // battery power (kW, positive while discharging) is derived from current and voltage
+    if (decoded && data.current_valid && data.voltage_valid) {
+        data.power = data.current * data.voltage / 1000.0f;
+        data.power_valid = true;
+    }
+    return decoded;
+}
+
+uint8_t getBroadcastIds(uint32_t* ids, uint8_t maxIds)
+{
+    uint8_t count = 0;
+    for (const CanSignal& sig : kKiaEv9Signals) {
+        if (sig.did != CAN_SIGNAL_BROADCAST) {
+            continue;
+        }
+        uint8_t i = 0;
+        while (i < count && ids[i] != sig.ecu) {
+            i++;
+        }
+        if (i == count && count < maxIds) {
+            ids[count++] = sig.ecu;
+        }
+    }
+    return count;
 }
@@ -1,6 +1,7 @@
 #ifndef CAN_DATA_H_INCLUDED
 #define CAN_DATA_H_INCLUDED
 
+#include <stddef.h>
 #include <stdint.h>
 
 struct AbrpTelemetry {
@@ -86,10 +87,47 @@ struct AbrpTelemetry {
 
     bool tire_pressure_rr_valid = false;
     float tire_pressure_rr = 0.0f; // kPa
+
+    // millis() when the latest decoded broadcast frame arrived, 0 if none yet
+    uint32_t broadcast_ts = 0;
+};
+
+// One signal inside a UDS DID response.
+// Bytes are big-endian; byteOffset counts from the response SID (0x62 is byte 0).
+// The raw value is the bitLength bits found bitOffset bits above the LSB of the
+// (bitOffset + bitLength + 7) / 8 bytes starting at byteOffset.
+// Decoded value = raw * scale + offset, stored in either a float field or a bool flag.
+// did value of signals carried by broadcast frames; ecu is then the frame's CAN ID
+// and byteOffset counts from the first data byte of the frame
+#define CAN_SIGNAL_BROADCAST 0
+
+struct CanSignal {
+    uint32_t ecu;          // request CAN ID (11 or 29 bits), or broadcast frame ID
+    uint32_t did;          // service + DID as polled, e.g. 0x220101, or CAN_SIGNAL_BROADCAST
+    uint8_t byteOffset;
+    uint8_t bitOffset;
+    uint8_t bitLength;
+    bool isSigned;
+    float scale;
+    float offset;
+    float AbrpTelemetry::* field;   // target value, or nullptr for a flag
+    bool AbrpTelemetry::* flag;     // target flag (raw != 0), or nullptr
+    bool AbrpTelemetry::* valid;    // validity flag set on decode
 };
 
 extern AbrpTelemetry abrpTelemetry;
 
 void resetAbrpTelemetry(AbrpTelemetry& data);
 
+// Decodes every signal of the given table that belongs to the ECU/DID response in one pass.
+// Returns the number of signals decoded.
+int decodeCanSignals(const CanSignal* table, size_t count, uint32_t ecu, uint32_t did,
+                     const uint8_t* response, size_t len, AbrpTelemetry& data);
+
+// Decodes a response with the signal table of the configured vehicle and updates derived fields.
+int decodeAbrpTelemetry(uint32_t ecu, uint32_t did, const uint8_t* response, size_t len, AbrpTelemetry& data);
+
+// Lists the distinct broadcast CAN IDs of the configured vehicle's table; returns their count.
+uint8_t getBroadcastIds(uint32_t* ids, uint8_t maxIds);
+
 #endif // CAN_DATA_H_INCLUDED
@@ -0,0 +1,131 @@
+/* Poll scheduler for OBD PIDs and UDS DIDs */
+/* Every request has a target period and a priority; the request with the */
+/* earliest deadline that fits the remaining cycle budget is issued first. */
+/* Failing requests back off exponentially so they stop eating bus time. */
+
+#include "serial_logging.h"
+#include "CAN-poll.h"
+
+// true if deadline a is earlier than deadline b (wrap-safe)
+static inline bool isEarlier(uint32_t a, uint32_t b)
+{
+  return (int32_t)(a - b) < 0;
+}
+
+void CPollScheduler::begin(PollEntry* entries, uint8_t count, uint32_t now)
+{
+  m_entries = entries;
+  m_count = count;
+  m_windowStart = now;
+  for (uint8_t i = 0; i < count; i++) {
+    PollEntry& e = entries[i];
+    e.due = now;
+    e.cost = POLL_DEFAULT_COST;
+    e.failures = 0;
+    e.okCount = 0;
+    e.failCount = 0;
+  }
+}
+
+int CPollScheduler::next(uint32_t now, uint32_t budget, bool force) const
+{
+  int best = -1;
+  for (uint8_t i = 0; i < m_count; i++) {
+    const PollEntry& e = m_entries[i];
+    if (isEarlier(now, e.due) || (!force && e.cost > budget)) continue;
+    if (best < 0) {
+      best = i;
+      continue;
+    }
+    const PollEntry& b = m_entries[best];
+    if (isEarlier(e.due, b.due) || (e.due == b.due && e.priority < b.priority)) {
+      best = i;
+    }
+  }
+  return best;
+}
+
+uint8_t CPollScheduler::collect(int first, uint32_t now, int out[], uint8_t max) const
+{
+  uint8_t n = 0;
+  if (first < 0 || max == 0) return 0;
+  out[n++] = first;
+  const PollEntry& f = m_entries[first];
+  for (uint8_t i = 0; i < m_count && n < max; i++) {
+    const PollEntry& e = m_entries[i];
+    if (i == first || e.kind != f.kind || e.canId != f.canId || isEarlier(now, e.due)) continue;
+    out[n++] = i;
+  }
+  return n;
+}
+
+void CPollScheduler::complete(int index, bool success, uint32_t now, uint32_t elapsed)
+{
+  if (index < 0 || index >= m_count) return;
+  PollEntry& e = m_entries[index];
+  // exponential moving average (1/4 weight) of the request duration
+  if (elapsed) {
+    if (elapsed > POLL_MAX_COST) elapsed = POLL_MAX_COST;
+    e.cost = (uint16_t)((e.cost * 3 + elapsed) / 4);
+  }
+  if (success) {
+    e.failures = 0;
+    if (e.okCount < 0xffff) e.okCount++;
+    // keep the phase; if the entry fell behind, make it due right away instead of bursting
+    e.due += e.period;
+    if (isEarlier(e.due, now)) e.due = now;
+  } else {
+    if (e.failures < 16) e.failures++;
+    if (e.failCount < 0xffff) e.failCount++;
+    uint32_t limit = e.period > POLL_MAX_BACKOFF ? e.period : POLL_MAX_BACKOFF;
+    uint32_t delay = e.period;
+    for (uint8_t i = 1; i < e.failures && delay < limit; i++) delay <<= 1;
+    if (delay > limit) delay = limit;
+    e.due = now + delay;
+  }
+}
+
+void CPollScheduler::defer(int index, uint32_t due)
+{
+  if (index < 0 || index >= m_count) return;
+  m_entries[index].due = due;
+}
+
+uint32_t CPollScheduler::idleTime(uint32_t now) const
+{
+  uint32_t idle = 0xffffffff;
+  for (uint8_t i = 0; i < m_count; i++) {
+    const PollEntry& e = m_entries[i];
+    if (!isEarlier(now, e.due)) return 0;
+    if (e.due - now < idle) idle = e.due - now;
+  }
+  return idle;
+}
+
+bool CPollScheduler::setPeriod(const char* name, uint32_t period)
+{
+  if (!name || !period) return false;
+  for (uint8_t i = 0; i < m_count; i++) {
+    if (!strcmp(m_entries[i].name, name)) {
+      m_entries[i].period = period;
+      return true;
+    }
+  }
+  return false;
+}
+
+void CPollScheduler::printStats(uint32_t now)
+{
+  uint32_t window = now - m_windowStart;
+  for (uint8_t i = 0; i < m_count; i++) {
+    PollEntry& e = m_entries[i];
+    // achieved period is the window length divided by the number of fresh values
+    uint32_t achieved = e.okCount ? window / e.okCount : 0;
+    serial_log_printf(LOG_INFO, "[POLL] %s target:%ums achieved:%ums ok:%u fail:%u cost:%ums%s",
+      e.name, (unsigned int)e.period, (unsigned int)achieved, e.okCount, e.failCount, e.cost,
+      e.failures ? " (backoff)" : "");
+    e.okCount = 0;
+    e.failCount = 0;
+  }
+  m_windowStart = now;
+}
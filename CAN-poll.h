@@ -0,0 +1,127 @@
+#ifndef CAN_POLL_H
+#define CAN_POLL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+
+// request kinds handled by the poll scheduler
+#define POLL_OBD_PID 0
+#define POLL_UDS_DID 1
+
+// upper bound for the backoff applied to a request that keeps failing (ms)
+#define POLL_MAX_BACKOFF 300000
+// request duration assumed until an entry has been timed once (ms)
+#define POLL_DEFAULT_COST 50
+// cap on a single request duration fed into the cost estimate (ms, the default cycle budget),
+// so one timeout does not price an entry out of the budget for many cycles
+#ifndef POLL_MAX_COST
+#define POLL_MAX_COST 400
+#endif
+
+struct PollEntry {
+  const char* name;   // key in /cfg/poll.ini and in stats output
+  uint8_t kind;       // POLL_OBD_PID or POLL_UDS_DID
+  uint32_t canId;     // UDS request CAN ID (11 or 29 bits), unused for OBD PIDs
+  uint32_t id;        // OBD PID or UDS DID
+  uint32_t period;    // target refresh period (ms)
+  uint8_t priority;   // 0 is most important, breaks deadline ties
+  uint32_t ttl;       // how long a reply is served from the response cache (ms); 0 means twice
+                      // the period, otherwise the entry is not requested again while its
+                      // reply is younger than min(period, ttl)
+  uint8_t cacheFlags; // CACHE_IGNITION: reply is also dropped when the ignition state changes
+
+  // runtime state, maintained by CPollScheduler
+  uint32_t due;       // deadline of the next request (millis)
+  uint16_t cost;      // smoothed request duration (ms)
+  uint8_t failures;   // consecutive failures driving the backoff
+  uint16_t okCount;   // successful reads in the current stats window
+  uint16_t failCount; // failed reads in the current stats window
+};
+
+// Earliest-deadline-first scheduler for OBD PIDs and UDS DIDs
+class CPollScheduler {
+public:
+  // attaches the entry table; every entry becomes due immediately
+  void begin(PollEntry* entries, uint8_t count, uint32_t now);
+  // index of the due entry with the earliest deadline whose cost fits the budget, or -1;
+  // with force the cost is ignored, so an expensive entry still runs at the start of a cycle
+  int next(uint32_t now, uint32_t budget, bool force = false) const;
+  // collects entries[first] and other due entries of the same kind and CAN ID
+  // (for multi-PID requests and for back-to-back DIDs on one ECU)
+  uint8_t collect(int first, uint32_t now, int out[], uint8_t max) const;
+  // records the outcome of a request and schedules the next deadline; elapsed 0 means the
+  // request was not sent and leaves the cost estimate alone
+  void complete(int index, bool success, uint32_t now, uint32_t elapsed);
+  // moves the deadline without a request, e.g. while the reply is still cached
+  void defer(int index, uint32_t due);
+  // time until the earliest deadline (ms), 0 if an entry is already due
+  uint32_t idleTime(uint32_t now) const;
+  // overrides the target period of the named entry
+  bool setPeriod(const char* name, uint32_t period);
+  // logs achieved vs. target period per entry and starts a new stats window
+  void printStats(uint32_t now);
+  PollEntry& entry(int index) { return m_entries[index]; }
+  uint8_t count() const { return m_count; }
+
+private:
+  PollEntry* m_entries = 0;
+  uint8_t m_count = 0;
+  uint32_t m_windowStart = 0;
+};
+
+// capacity of the acquisition sample ring (power of two)
+#define POLL_RING_SIZE 64
+
+// one decoded value handed from the acquisition task to process()
+struct PollSample {
+  uint16_t pid;    // buffer PID (0x100 | OBD PID for mode 01)
+  int32_t value;
+};
+
+// Single-producer/single-consumer ring; push() and pop() never block
+class CSampleRing {
+public:
+  // producer side; drops the sample and counts it when the ring is full
+  bool push(const PollSample& sample)
+  {
+    uint16_t head = m_head.load(std::memory_order_relaxed);
+    if ((uint16_t)(head - m_tail.load(std::memory_order_acquire)) >= POLL_RING_SIZE) {
+      m_dropped++;
+      return false;
+    }
+    m_items[head & (POLL_RING_SIZE - 1)] = sample;
+    m_head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+  // producer side; pushes all samples or, if they do not all fit, none (counted as dropped)
+  bool push(const PollSample* samples, uint8_t count)
+  {
+    uint16_t head = m_head.load(std::memory_order_relaxed);
+    if ((uint16_t)(head - m_tail.load(std::memory_order_acquire)) + count > POLL_RING_SIZE) {
+      m_dropped += count;
+      return false;
+    }
+    for (uint8_t i = 0; i < count; i++) m_items[(uint16_t)(head + i) & (POLL_RING_SIZE - 1)] = samples[i];
+    m_head.store(head + count, std::memory_order_release);
+    return true;
+  }
+  // consumer side
+  bool pop(PollSample& sample)
+  {
+    uint16_t tail = m_tail.load(std::memory_order_relaxed);
+    if (tail == m_head.load(std::memory_order_acquire)) return false;
+    sample = m_items[tail & (POLL_RING_SIZE - 1)];
+    m_tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+  uint32_t dropped() const { return m_dropped; }
+
+private:
+  PollSample m_items[POLL_RING_SIZE];
+  std::atomic<uint16_t> m_head{0};
+  std::atomic<uint16_t> m_tail{0};
+  uint32_t m_dropped = 0;
+};
+
+#endif  // CAN_POLL_H
@@ -23,148 +23,414 @@ static bool hasAdapterErrorToken(const char* buf)
   return false;
 }
 
-static bool ensureAutoFlowControlEnabled()
+// minimum idle gap between the end of one UDS read and the next request (ms)
+#ifndef UDS_MIN_REQUEST_GAP
+#define UDS_MIN_REQUEST_GAP 75
+#endif
+// timeout until a response latency has been learned for the ECU (ms)
+#define UDS_TIMEOUT 5000
+// timeout of one ECU in a DTC sweep until its latency has been learned (ms)
+#define UDS_DTC_TIMEOUT 300
+
+// Starts a new message in the caller-owned buffer.
+void CIsoTpReassembler::begin(uint8_t* buf, size_t bufsize)
 {
-  static uint32_t lastCheck = 0;
-  uint32_t now = millis();
-  if (now - lastCheck < 10000) {
-    return true;
-  }
-  lastCheck = now;
-  if (!obd.link) return false;
-  char atbuf[64] = {0};
-  int n = obd.link->sendCommand("ATCFC1\r", atbuf, sizeof(atbuf), 1000);
-  if (!n || !strstr(atbuf, "OK")) {
-    serial_log_print(LOG_INFO, "[UDS] ATCFC1 verify failed");
-    serial_log_print(LOG_INFO, atbuf);
-    return false;
-  }
+  m_buf = buf;
+  m_size = bufsize;
+  m_len = 0;
+  m_total = 0;
+  m_seq = 0;
+  m_error = ISOTP_ERR_NONE;
+}
+
+bool CIsoTpReassembler::append(const uint8_t* data, uint8_t len)
+{
+  // the last consecutive frame is padded, never copy beyond the announced length
+  if (m_len + len > m_total) len = m_total - m_len;
+  // memmove, as the text decoder writes into the buffer it is reading from
+  memmove(m_buf + m_len, data, len);
+  m_len += len;
   return true;
 }
 
+bool CIsoTpReassembler::feedFrame(const uint8_t* data, uint8_t len)
+{
+  if (!len) return fail(ISOTP_ERR_FORMAT);
+  switch (data[0] >> 4) {
+  case 0: // single frame
+    if ((data[0] & 0xF) == 0 || (data[0] & 0xF) >= len) return fail(ISOTP_ERR_FORMAT);
+    return single(data + 1, data[0] & 0xF);
+  case 1: // first frame
+    if (len < 2) return fail(ISOTP_ERR_FORMAT);
+    return first(((uint16_t)(data[0] & 0xF) << 8) | data[1], data + 2, len - 2);
+  case 2: // consecutive frame
+    return consecutive(data[0] & 0xF, data + 1, len - 1);
+  case 3: // flow control sent by the other side, carries no payload
+    return true;
+  }
+  return fail(ISOTP_ERR_FORMAT);
+}
 
+bool CIsoTpReassembler::single(const uint8_t* data, uint8_t len)
+{
+  if (m_total) return fail(ISOTP_ERR_FORMAT);
+  if (len > m_size) return fail(ISOTP_ERR_OVERFLOW);
+  m_total = len;
+  return append(data, len);
+}
 
-// function to convert CAN answer to a standardized string
-bool parseObdBufToPayload(const char* buf, char* outPayload, size_t outPayloadSize)
+bool CIsoTpReassembler::first(uint16_t total, const uint8_t* data, uint8_t len)
 {
-  if (!buf || !outPayload || outPayloadSize == 0) {
-    return false;
-  }
+  if (m_total) return fail(ISOTP_ERR_FORMAT);
+  if (total > m_size) return fail(ISOTP_ERR_OVERFLOW);
+  m_total = total;
+  m_seq = 1;
+  return append(data, len);
+}
 
-  size_t j = 0;
-  bool afterColon = false;
-  bool skippedLengthPrefix = false;
+bool CIsoTpReassembler::consecutive(uint8_t seq, const uint8_t* data, uint8_t len)
+{
+  if (!m_total || m_error) return fail(m_error ? m_error : ISOTP_ERR_FORMAT);
+  if (seq != (m_seq & 0xF)) return fail(ISOTP_ERR_SEQUENCE);
+  m_seq++;
+  return append(data, len);
+}
 
-  for (size_t i = 0; buf[i] != '\0'; i++) {
-    char c = buf[i];
+bool CIsoTpReassembler::finish()
+{
+  if (m_error) return false;
+  if (!m_total) return fail(ISOTP_ERR_FORMAT);
+  if (m_len < m_total) return fail(ISOTP_ERR_TRUNCATED);
+  return true;
+}
 
-    // Skip the leading length field, e.g. "02E "
-    if (!skippedLengthPrefix) {
-      if (c == ' ') {
-        skippedLengthPrefix = true;
+// Converts the adapter's ISO-TP text reply into bytes.
+// Single frames arrive as one line of bytes; multi-frame replies as a length line ("03E")
+// followed by "N: ..." lines where N is the 4-bit frame sequence number (0 = first frame).
+int decodeIsoTpText(const char* text, int len, uint8_t* out, size_t outSize, uint8_t* error)
+{
+  CIsoTpReassembler isotp;
+  isotp.begin(out, outSize);
+  uint16_t total = 0;
+  bool ok = true;
+  CLineIterator lines(text, len);
+  const char* line;
+  int lineLen;
+  while (ok && lines.next(line, lineLen)) {
+    const char* end = line + lineLen;
+    const char* colon = (const char*)memchr(line, ':', lineLen);
+    uint8_t frame[16];
+    if (colon) {
+      // hex2uint16() stops at the colon
+      int n = decodeHexBytes(colon + 1, end, frame, sizeof(frame));
+      if (colon == line || colon - line > 2 || hexDigit(*line) < 0 || n < 0 || !total) {
+        ok = false;
+        break;
       }
-      continue;
+      uint8_t index = hex2uint16(line) & 0xF;
+      ok = (index == 0 && isotp.length() == 0) ? isotp.first(total, frame, n) : isotp.consecutive(index, frame, n);
+    } else if (lineLen <= 3 && !memchr(line, ' ', lineLen)) {
+      // length line of a multi-frame reply, hex2uint16() stops at the line break
+      total = hex2uint16(line);
+    } else {
+      int n = decodeHexBytes(line, end, frame, sizeof(frame));
+      ok = n > 0 && isotp.single(frame, n);
     }
+  }
+  if (ok) ok = isotp.finish();
+  if (error) *error = ok ? ISOTP_ERR_NONE : (isotp.error() ? isotp.error() : ISOTP_ERR_FORMAT);
+  return ok ? isotp.length() : 0;
+}
 
-    // When we find ":", the data section begins after it
-    if (c == ':') {
-      afterColon = true;
-      continue;
-    }
 
-    // A line break resets the state so the next line number is ignored until the next ':'
-    if (c == '\r' || c == '\n') {
-      afterColon = false;
-      continue;
-    }
+uint32_t udsReplyId(uint32_t canId)
+{
+  // 29-bit normal fixed addressing swaps target and source address (18DA<target><source>)
+  if (canId > 0x7FF) return (canId & 0xFFFF0000) | ((canId & 0xFF) << 8) | ((canId >> 8) & 0xFF);
+  return canId + 8;
+}
 
-    // Before ":", ignore line numbers such as "0", "1", "2"
-    if (!afterColon) {
+// Splits a DID call such as 0x22F190 into its request bytes, dropping leading zero bytes.
+static size_t buildDIDRequest(uint32_t did, uint8_t* msg)
+{
+  size_t msgLen = 0;
+  for (int shift = 24; shift >= 0; shift -= 8) {
+    uint8_t b = (uint8_t)((did >> shift) & 0xFF);
+    if (msgLen == 0 && b == 0 && shift > 0) {
       continue;
     }
-
-    // Keep only hex characters from the data section itself, skipping spaces
-    bool isHex =
-      (c >= '0' && c <= '9') ||
-      (c >= 'A' && c <= 'F') ||
-      (c >= 'a' && c <= 'f');
-
-    if (isHex) {
-      if (j >= outPayloadSize - 1) {
-        outPayload[0] = '\0';
-        return false; // output buffer too small
-      }
-      // Normalize to uppercase
-      if (c >= 'a' && c <= 'f') c = c - 'a' + 'A';
-      outPayload[j++] = c;
-    }
+    msg[msgLen++] = b;
   }
+  return msgLen;
+}
 
-  outPayload[j] = '\0';
-  return (j > 0);
+// Sends a UDS request to canId and returns the adapter's reply length.
+// Paced requests keep the idle gap after the previous read; timeout applies until a latency is learned.
+static int sendUDSRequest(uint32_t canId, const uint8_t* msg, size_t msgLen, char* text, size_t textSize,
+                          unsigned int timeout = UDS_TIMEOUT, bool paced = true)
+{
+  // Give adapter/ECU a short idle gap between consecutive UDS reads.
+  static uint32_t lastReadDone = 0;
+  uint32_t gap = millis() - lastReadDone;
+  if (paced && gap < UDS_MIN_REQUEST_GAP) delay(UDS_MIN_REQUEST_GAP - gap);
+
+  uint32_t start = millis();
+  int n = obd.sendCANMessage((byte*)msg, msgLen, text, textSize, obd.getTimeout(canId, msg[0], timeout));
+  lastReadDone = millis();
+  bool responded = n && !hasAdapterErrorToken(text);
+  obd.recordLatency(canId, msg[0], lastReadDone - start, responded);
+  return n;
 }
 
+// Checks a decoded response: 0x7F sets nrc, a positive one must echo the service + 0x40 and the request bytes.
+static bool checkUDSResponse(const uint8_t* msg, size_t msgLen, const uint8_t* rsp, int len, uint8_t* nrc)
+{
+  if (rsp[0] == 0x7F) {
+    if (nrc && len >= 3) *nrc = rsp[2];
+    return false;
+  }
+  return len >= (int)msgLen && rsp[0] == (uint8_t)(msg[0] + 0x40) && !memcmp(rsp + 1, msg + 1, msgLen - 1);
+}
 
 // Code to take a UDS DID call and send it to CAN with help of SendCANMessage
-bool readUDS_DID(uint32_t canId, uint32_t did, String& outResponse)
+// The adapter's text reply is received into buf and decoded in place.
+int readUDS_DID(uint32_t canId, uint32_t did, uint8_t* buf, size_t bufsize, uint8_t* nrc)
 {
-  outResponse = "";
-  if (!ensureAutoFlowControlEnabled()) {
+  if (nrc) *nrc = 0;
+  if (!buf || bufsize < 8) return 0;
+  // COBD caches adapter state, so these only cost a round trip when something changed
+  if (!obd.setFlowControl(true)) {
     serial_log_print(LOG_INFO, "UDS read failed: auto flow control unavailable");
-    return false;
+    return 0;
   }
 
   uint8_t msg[4]; // the request payload for the DID call
-  size_t msgLen = 0;
-
-  for (int shift = 24; shift >= 0; shift -= 8) {
-    uint8_t b = (uint8_t)((did >> shift) & 0xFF);
-    if (msgLen == 0 && b == 0 && shift > 0) {
-      continue;
-    }
-    msg[msgLen++] = b;
-  }
+  size_t msgLen = buildDIDRequest(did, msg);
 
   if (msgLen == 0) {
     serial_log_print(LOG_INFO, "UDS read failed: empty DID");
-    return false;
+    return 0;
   }
 
-  obd.setCANID((uint16_t)canId);
-  obd.setHeaderMask(0x7FF);
-  obd.setHeaderFilter(canId + 0x8);  // DID reply CAN ID is normally request CAN ID + 8 (non-standard replies may differ)
+  obd.setCANID(canId);
+  obd.setHeaderMask(canId > 0x7FF ? 0x1FFFFFFF : 0x7FF);
+  obd.setHeaderFilter(udsReplyId(canId));  // non-standard replies may use another ID
   //obd.sniff();
 
-
-  static char buf[1024];
-  buf[0] = '\0';
-  static char payload[1024];
-  payload[0] = '\0';
-
-  // Give adapter/ECU a short idle gap between consecutive UDS reads.
-  delay(75);
-  
-  int n = obd.sendCANMessage(msg, msgLen, buf, sizeof(buf), 5000);
+  char* text = (char*)buf;
+  int n = sendUDSRequest(canId, msg, msgLen, text, bufsize);
   if (!n) {
     serial_log_print(LOG_INFO, "UDS read failed");
-    return false;
+    return 0;
   }
 
-  serial_log_print(LOG_INFO, "UDS raw adapter:");
-  serial_log_print(LOG_INFO, buf);
-  outResponse = buf;
+  serial_log_print(LOG_DEBUG, "UDS raw adapter:");
+  serial_log_print(LOG_DEBUG, text);
 
-  if (hasAdapterErrorToken(buf)) {
+  if (hasAdapterErrorToken(text)) {
     serial_log_print(LOG_INFO, "UDS read failed: adapter signaled error");
-    return false;
+    return 0;
   }
 
-  if (!parseObdBufToPayload(buf, payload, sizeof(payload))) {
-    serial_log_print(LOG_INFO, "Parse failed");
-    return false;
+  uint8_t error;
+  int len = decodeIsoTpText(text, n, buf, bufsize, &error);
+  if (!len) {
+    serial_log_printf(LOG_INFO, "UDS read failed: ISO-TP error %u", error);
+    return 0;
   }
+  if (!checkUDSResponse(msg, msgLen, buf, len, nrc)) {
+    if (buf[0] == 0x7F) {
+      serial_log_printf(LOG_INFO, "UDS read failed: negative response %02X", len >= 3 ? buf[2] : 0);
+    } else {
+      serial_log_print(LOG_INFO, "UDS read failed: unexpected response");
+    }
+    return 0;
+  }
+  return len;
+}
+
+// Reads a DID from every ECU answering one functional request.
+// Headers are turned on so each reply frame carries its CAN ID; the frames of all ECUs are
+// reassembled side by side into buf, each ECU getting the length its first frame announces.
+int readUDS_DIDAll(uint32_t canId, uint32_t did, uint8_t* buf, size_t bufsize, UdsEcuResponse ecus[], uint8_t maxEcus)
+{
+  static char text[UDS_BUFFER_SIZE];
+  CIsoTpReassembler isotp[UDS_MAX_ECUS];
+  uint8_t msg[4];
+  size_t msgLen = buildDIDRequest(did, msg);
+  if (!buf || !msgLen || !maxEcus) return 0;
+  if (maxEcus > UDS_MAX_ECUS) maxEcus = UDS_MAX_ECUS;
+  if (!obd.setFlowControl(true) || !obd.setHeaders(true)) {
+    serial_log_print(LOG_INFO, "UDS fan-in failed: adapter setup");
+    return 0;
+  }
+  // physical responses to the tester: 7E8-7EF, or 18DA<tester>xx for 29-bit
+  bool extended = canId > 0x7FF;
+  obd.setCANID(canId);
+  obd.setHeaderMask(extended ? 0x1FFFFF00 : 0x7F8);
+  obd.setHeaderFilter(extended ? 0x18DA0000 | ((canId & 0xFF) << 8) : 0x7E8);
+  int n = sendUDSRequest(canId, msg, msgLen, text, sizeof(text));
+  obd.setHeaders(false);
+
+  uint8_t count = 0;
+  size_t used = 0;
+  CLineIterator lines(text, n);
+  const char* line;
+  int lineLen;
+  while (lines.next(line, lineLen)) {
+    const char* end = line + lineLen;
+    // "7E8 ...", or "18 DA F1 10 ..." for 29-bit IDs with spaces on ("18DAF110 ..." with ATS0)
+    uint32_t id;
+    int idLen = decodeCanHeader(line, end, &id);
+    if (!idLen) continue;
+    uint8_t frame[8];
+    int len = decodeHexBytes(line + idLen, end, frame, sizeof(frame));
+    if (len <= 0) continue;
+    uint8_t i = 0;
+    while (i < count && ecus[i].canId != id) i++;
+    if (i == count) {
+      // a new ECU starts with a single or first frame that tells how much room it needs
+      size_t total = (frame[0] >> 4) == 0 ? (frame[0] & 0xF) : (frame[0] >> 4) == 1 && len >= 2 ? ((size_t)(frame[0] & 0xF) << 8) | frame[1] : 0;
+      if (!total || count == maxEcus || used + total > bufsize) continue;
+      ecus[count].canId = id;
+      ecus[count].data = buf + used;
+      ecus[count].len = 0;
+      ecus[count].nrc = 0;
+      isotp[count].begin(buf + used, total);
+      used += total;
+      count++;
+    }
+    isotp[i].feedFrame(frame, len);
+  }
+
+  uint8_t answered = 0;
+  for (uint8_t i = 0; i < count; i++) {
+    if (isotp[i].finish() && checkUDSResponse(msg, msgLen, ecus[i].data, isotp[i].length(), &ecus[i].nrc)) {
+      ecus[i].len = isotp[i].length();
+    } else if (!ecus[i].nrc) {
+      serial_log_printf(LOG_INFO, "UDS fan-in: %X invalid response (ISO-TP error %u)", (unsigned int)ecus[i].canId, isotp[i].error());
+      continue;
+    }
+    // keep ECUs with a positive or a negative response
+    if (answered != i) ecus[answered] = ecus[i];
+    answered++;
+  }
+  return answered;
+}
 
-  serial_log_print(LOG_INFO, "Payload only:");
-  serial_log_print(LOG_INFO, payload);
+// Reads the DTCs matching statusMask with ReadDTCInformation (19 02 <mask>).
+// The reply is 59 02 <availability mask> followed by 3 DTC bytes and a status byte per code.
+int readUDS_DTC(uint32_t canId, uint8_t statusMask, uint8_t ecu, UdsDtc* out, int maxCodes, uint8_t* nrc,
+  bool* truncated)
+{
+  static uint8_t buf[UDS_BUFFER_SIZE];
+  if (nrc) *nrc = 0;
+  if (truncated) *truncated = false;
+  if (!obd.setFlowControl(true)) return -1;
+  uint8_t msg[3] = {0x19, 0x02, statusMask};
+  obd.setCANID(canId);
+  obd.setHeaderMask(canId > 0x7FF ? 0x1FFFFFFF : 0x7FF);
+  obd.setHeaderFilter(udsReplyId(canId));
+  // back to back: every request goes to another ECU
+  int n = sendUDSRequest(canId, msg, sizeof(msg), (char*)buf, sizeof(buf), UDS_DTC_TIMEOUT, false);
+  if (!n || hasAdapterErrorToken((char*)buf)) return -1;
+  int len = decodeIsoTpText((char*)buf, n, buf, sizeof(buf));
+  if (len < 3 || !checkUDSResponse(msg, 2, buf, len, nrc)) return -1;
+  int count = 0;
+  for (int i = 3; i + 4 <= len; i += 4) {
+    if (!(buf[i + 3] & statusMask)) continue;
+    if (count == maxCodes) {
+      if (truncated) *truncated = true;
+      break;
+    }
+    out[count].code = ((uint32_t)buf[i] << 16) | ((uint32_t)buf[i + 1] << 8) | buf[i + 2];
+    out[count].status = buf[i + 3];
+    out[count].ecu = ecu;
+    count++;
+  }
+  return count;
+}
+
+static int compareDtcs(const UdsDtc& a, const UdsDtc& b)
+{
+  if (a.ecu != b.ecu) return a.ecu < b.ecu ? -1 : 1;
+  if (a.code != b.code) return a.code < b.code ? -1 : 1;
+  return 0;
+}
+
+// Orders records by ECU, then code; the lists are short, so insertion sort.
+static void sortDtcs(UdsDtc* codes, int count)
+{
+  for (int i = 1; i < count; i++) {
+    UdsDtc d = codes[i];
+    int j = i;
+    for (; j > 0 && compareDtcs(codes[j - 1], d) > 0; j--) codes[j] = codes[j - 1];
+    codes[j] = d;
+  }
+}
+
+bool CDtcSweep::addEcu(uint32_t canId)
+{
+  for (uint8_t i = 0; i < m_ecuCount; i++) {
+    if (m_ecus[i] == canId) return true;
+  }
+  if (m_ecuCount == DTC_SWEEP_MAX_ECUS) return false;
+  m_ecus[m_ecuCount++] = canId;
   return true;
 }
+
+// Reads every ECU once, then walks the old and new record lists side by side to report the differences.
+int CDtcSweep::sweep(uint8_t statusMask, DtcChangeCallback onChange)
+{
+  UdsDtc next[DTC_SWEEP_MAX_CODES];
+  uint16_t count = 0;
+  uint8_t answered = 0;
+  for (uint8_t e = 0; e < m_ecuCount; e++) {
+    int n = -1;
+    if (!(m_unsupported & (1UL << e))) {
+      uint8_t nrc;
+      bool truncated = false;
+      n = readUDS_DTC(m_ecus[e], statusMask, e, next + count, DTC_SWEEP_MAX_CODES - count, &nrc, &truncated);
+      // an ECU without service 0x19 is not asked again
+      if (nrc == UDS_NRC_SERVICE_NOT_SUPPORTED) m_unsupported |= 1UL << e;
+      // a partial list would report the codes left out as cleared
+      if (truncated) n = -1;
+    }
+    if (n < 0) {
+      // no (complete) answer says nothing about its codes, keep the previous ones
+      for (uint16_t i = 0; i < m_count && count < DTC_SWEEP_MAX_CODES; i++) {
+        if (m_codes[i].ecu == e) next[count++] = m_codes[i];
+      }
+      continue;
+    }
+    sortDtcs(next + count, n);
+    count += n;
+    answered++;
+  }
+  if (!answered) return -1;
+
+  int changes = 0;
+  uint16_t i = 0, j = 0;
+  while (i < m_count || j < count) {
+    int order = i == m_count ? 1 : j == count ? -1 : compareDtcs(m_codes[i], next[j]);
+    if (order < 0) {
+      if (onChange) onChange(m_ecus[m_codes[i].ecu], m_codes[i], true);
+      changes++;
+      i++;
+    } else if (order > 0) {
+      if (onChange) onChange(m_ecus[next[j].ecu], next[j], false);
+      changes++;
+      j++;
+    } else {
+      if ((m_codes[i].status ^ next[j].status) & statusMask) {
+        if (onChange) onChange(m_ecus[next[j].ecu], next[j], false);
+        changes++;
+      }
+      i++;
+      j++;
+    }
+  }
+  memcpy(m_codes, next, count * sizeof(UdsDtc));
+  m_count = count;
+  return changes;
+}
@@ -3,9 +3,118 @@
 
 #include <stddef.h>
 #include <stdint.h>
-#include <WString.h>
 
-bool readUDS_DID(uint32_t canId, uint32_t did, String& outResponse);
-bool parseObdBufToPayload(const char* buf, char* outPayload, size_t outPayloadSize);
+// adapter text buffer needed per UDS read; the binary response is decoded in place
+// (1024 characters hold about 245 payload bytes of multi-frame reply, or ~60 DTC records)
+#define UDS_BUFFER_SIZE 1024
+
+// ISO-TP reassembly errors
+#define ISOTP_ERR_NONE 0
+#define ISOTP_ERR_FORMAT 1     // unexpected frame type or malformed adapter line
+#define ISOTP_ERR_SEQUENCE 2   // consecutive frame out of order
+#define ISOTP_ERR_TRUNCATED 3  // fewer bytes than announced by the first frame
+#define ISOTP_ERR_OVERFLOW 4   // message larger than the caller's buffer
+
+// Reassembles one ISO-TP message into a caller-owned buffer
+class CIsoTpReassembler {
+public:
+  void begin(uint8_t* buf, size_t bufsize);
+  // feeds the data bytes of one raw CAN frame (PCI byte first), as captured in monitor mode
+  bool feedFrame(const uint8_t* data, uint8_t len);
+  // single frame payload (PCI already removed)
+  bool single(const uint8_t* data, uint8_t len);
+  // first frame announcing the total message length, followed by its payload bytes
+  bool first(uint16_t total, const uint8_t* data, uint8_t len);
+  // consecutive frame with 4-bit sequence number
+  bool consecutive(uint8_t seq, const uint8_t* data, uint8_t len);
+  // checks the received length against the first frame and trims padding
+  bool finish();
+  bool complete() const { return m_total && m_len >= m_total; }
+  size_t length() const { return m_len; }
+  uint8_t error() const { return m_error; }
+
+private:
+  bool append(const uint8_t* data, uint8_t len);
+  bool fail(uint8_t error) { m_error = error; return false; }
+  uint8_t* m_buf = 0;
+  size_t m_size = 0;
+  size_t m_len = 0;
+  size_t m_total = 0;
+  uint8_t m_seq = 0;
+  uint8_t m_error = ISOTP_ERR_NONE;
+};
+
+// decodes the adapter's ISO-TP text reply (CAF1 format) into bytes; out may alias text
+int decodeIsoTpText(const char* text, int len, uint8_t* out, size_t outSize, uint8_t* error = 0);
+// UDS negative response codes meaning the ECU does not have the DID at all
+#define UDS_NRC_SERVICE_NOT_SUPPORTED 0x11
+#define UDS_NRC_REQUEST_OUT_OF_RANGE 0x31
+
+// reads a DID; returns the response length (starting with 0x62) decoded into buf, or 0 on failure
+// with nrc set to the negative response code if the ECU rejected the request (0 otherwise)
+// canId is an 11-bit or 29-bit physical request ID
+int readUDS_DID(uint32_t canId, uint32_t did, uint8_t* buf, size_t bufsize, uint8_t* nrc = 0);
+
+// physical response ID of a request ID: +8 for 11-bit, source/target swapped for 29-bit (18DAxxyy)
+uint32_t udsReplyId(uint32_t canId);
+
+// functional request IDs reaching every emission-related ECU
+#define UDS_FUNCTIONAL_ID 0x7DF
+#define UDS_FUNCTIONAL_ID_29 0x18DB33F1
+// most ECUs collected from one functional request
+#define UDS_MAX_ECUS 8
+
+// one ECU's answer to a functional request
+struct UdsEcuResponse {
+  uint32_t canId;       // response CAN ID of the ECU
+  const uint8_t* data;  // response inside the caller's buffer (starting with 0x62)
+  uint16_t len;         // response length, 0 if the ECU answered negatively
+  uint8_t nrc;          // negative response code, 0 for a positive response
+};
+
+// reads a DID from all ECUs answering a functional request (UDS_FUNCTIONAL_ID or
+// UDS_FUNCTIONAL_ID_29) within one wait window; responses are stored side by side in buf
+// returns the number of ECUs that answered, positively or negatively
+int readUDS_DIDAll(uint32_t canId, uint32_t did, uint8_t* buf, size_t bufsize, UdsEcuResponse ecus[], uint8_t maxEcus);
+
+// one diagnostic trouble code reported by ReadDTCInformation
+struct UdsDtc {
+  uint32_t code;   // 3-byte DTC, high byte first
+  uint8_t status;  // DTC status bits (0x01 test failed, 0x04 pending, 0x08 confirmed)
+  uint8_t ecu;     // index of the ECU in the sweep
+};
+
+// reads the DTCs whose status matches statusMask from one ECU (19 02); records are tagged with ecu
+// returns the number of records stored, or -1 if the ECU gave no positive response;
+// truncated is set when matching records were left out because out was full
+int readUDS_DTC(uint32_t canId, uint8_t statusMask, uint8_t ecu, UdsDtc* out, int maxCodes, uint8_t* nrc = 0,
+  bool* truncated = 0);
+
+// most ECUs and DTC records tracked by CDtcSweep
+#define DTC_SWEEP_MAX_ECUS 16
+#define DTC_SWEEP_MAX_CODES 64
+
+// called once per new, changed (status) or cleared DTC
+typedef void (*DtcChangeCallback)(uint32_t canId, const UdsDtc& dtc, bool cleared);
+
+// Reads DTCs from a list of ECUs and reports what changed since the previous sweep
+class CDtcSweep {
+public:
+  // adds an ECU request ID to the sweep; duplicates are ignored
+  bool addEcu(uint32_t canId);
+  // reads all ECUs back to back; ECUs that do not answer keep their previous codes
+  // returns the number of changes, or -1 if no ECU answered
+  int sweep(uint8_t statusMask, DtcChangeCallback onChange);
+  uint8_t ecuCount() const { return m_ecuCount; }
+  uint16_t count() const { return m_count; }
+  const UdsDtc* codes() const { return m_codes; }
+
+private:
+  uint32_t m_ecus[DTC_SWEEP_MAX_ECUS];
+  uint32_t m_unsupported = 0;  // ECUs that rejected service 0x19
+  uint8_t m_ecuCount = 0;
+  UdsDtc m_codes[DTC_SWEEP_MAX_CODES];  // ordered by ECU, then code
+  uint16_t m_count = 0;
+};
 
 #endif  // CAN_UDS_H
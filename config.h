@@ -40,14 +40,20 @@
 * Circular Buffer Configuration
 **************************************/
 #if BOARD_HAS_PSRAM
-#define BUFFER_SLOTS 1024 /* max number of buffer slots */
-#define BUFFER_LENGTH 384 /* bytes per slot */
+#define BUFFER_ARENA_SIZE 393216 /* bytes of queued sample data */
+#define BUFFER_SLOTS 4096 /* max number of queued buffers */
 #define SERIALIZE_BUFFER_SIZE 4096 /* bytes */
 #else
-#define BUFFER_SLOTS 32 /* max number of buffer slots */
-#define BUFFER_LENGTH 256 /* bytes per slot */
+#define BUFFER_ARENA_SIZE 8192 /* bytes of queued sample data */
+#define BUFFER_SLOTS 96 /* max number of queued buffers */
 #define SERIALIZE_BUFFER_SIZE 1024 /* bytes */
 #endif
+// a buffer serializes to at most SERIALIZE_EXPANSION text bytes per binary byte ("-2147483648;"
+// for an int32, "FFFF:" and "," for an element head), plus the device ID, timestamp and checksum,
+// so the largest buffer still fits one packet (TX_PACKET_SIZE, see below)
+#define SERIALIZE_EXPANSION 3
+#define SERIALIZE_OVERHEAD 32 /* bytes */
+#define BUFFER_LENGTH ((TX_PACKET_SIZE - SERIALIZE_OVERHEAD) / SERIALIZE_EXPANSION) /* max bytes per buffer */
 
 /**************************************
 * Configuration Definitions
@@ -64,6 +70,9 @@
 #define PROTOCOL_HTTPS_GET 2
 #define PROTOCOL_HTTPS_POST 3
 
+#define TX_NEWEST 0
+#define TX_DUAL 1
+
 /**************************************
 * OBD-II configurations
 **************************************/
@@ -73,6 +82,41 @@
 
 // maximum consecutive OBD access errors before entering standby
 #define MAX_OBD_ERRORS 3
+// skip the full adapter init after wake-up while the adapter still holds the cached state
+#ifndef OBD_WARM_START
+#define OBD_WARM_START 1
+#endif
+// probe the co-processor UART link for a faster baud rate once per device (result kept in NVS)
+#ifndef LINK_UART_NEGOTIATE
+#define LINK_UART_NEGOTIATE 1
+#endif
+// candidate link rates, fastest first
+#define LINK_UART_RATES {1000000, 921600, 500000, 460800, 230400}
+
+// time budget per data cycle for scheduled PID/DID requests (ms)
+#define POLL_CYCLE_BUDGET 400
+// interval of poll scheduler rate statistics (ms)
+#define POLL_STATS_INTERVAL 60000
+// core the OBD/CAN acquisition task is pinned to
+#ifndef OBD_TASK_CORE
+#define OBD_TASK_CORE 0
+#endif
+// pause between acquisition task cycles (ms)
+#define OBD_TASK_INTERVAL 20
+// minimum time per data cycle spent capturing broadcast CAN frames in monitor mode (ms, 0 to disable)
+#ifndef CAN_MONITOR_WINDOW
+#define CAN_MONITOR_WINDOW 200
+#endif
+// longest monitor window when no request is due sooner (ms); the link is held meanwhile
+#ifndef CAN_MONITOR_MAX_WINDOW
+#define CAN_MONITOR_MAX_WINDOW 1000
+#endif
+// interval of the UDS DTC sweep over the ECUs in pollTable (ms, 0 to disable)
+#ifndef DTC_SWEEP_INTERVAL
+#define DTC_SWEEP_INTERVAL 60000
+#endif
+// DTC status bits a sweep reports (0x08 confirmed, 0x04 pending)
+#define DTC_STATUS_MASK 0x0C
 
 /**************************************
 * Networking configurations
@@ -130,6 +174,27 @@
 #define STATIONARY_TIME_TABLE {10, 60, 180} /* seconds */
 #define DATA_INTERVAL_TABLE {1000, 2000, 5000} /* ms */
 #define PING_BACK_INTERVAL 900 /* seconds */
+// transmit policy: TX_NEWEST only sends the newest buffer (a backlog goes out newest-first and a
+// failed send is lost), TX_DUAL sends fresh data first and drains the backlog oldest-first in between
+#ifndef TX_POLICY
+#define TX_POLICY TX_DUAL
+#endif
+// packet size limit when packing several buffers into one packet (TX_DUAL), at most
+// SERIALIZE_BUFFER_SIZE; a UDP datagram is kept below the usual 1500-byte link MTU
+#if SERVER_PROTOCOL == PROTOCOL_UDP && SERIALIZE_BUFFER_SIZE > 1400
+#define TX_PACKET_SIZE 1400 /* bytes */
+#else
+#define TX_PACKET_SIZE SERIALIZE_BUFFER_SIZE
+#endif
+static_assert(TX_PACKET_SIZE <= SERIALIZE_BUFFER_SIZE &&
+  BUFFER_LENGTH * SERIALIZE_EXPANSION + SERIALIZE_OVERHEAD <= TX_PACKET_SIZE,
+  "a full buffer must serialize into one packet");
+// maximum number of buffers packed into one packet (HTTPS GET only reports the position)
+#if SERVER_PROTOCOL == PROTOCOL_HTTPS_GET
+#define TX_BATCH_MAX 1
+#else
+#define TX_BATCH_MAX 64
+#endif
 #define SIGNAL_CHECK_INTERVAL 10 /* seconds */
 
 // ABRP keys
@@ -144,6 +209,11 @@
 #define STORAGE STORAGE_SD
 #endif
 
+// record the OBD adapter conversation to /DATA/<file id>.TRC (SD storage only), replayable with CReplayLink
+#ifndef ENABLE_CAN_TRACE
+#define ENABLE_CAN_TRACE 0
+#endif
+
 /**************************************
 * MEMS sensors
 **************************************/
@@ -16,6 +16,7 @@
 * Implemented HTTP APIs:
 * /api/info - device info
 * /api/live - live data (OBD/GPS/MEMS)
+* /api/timeouts - learned OBD/UDS response timeouts
 * /api/control - issue a control command
 * /api/list - list of log files
 * /api/log/<file #> - raw CSV format log file
@@ -53,6 +54,7 @@ HttpParam httpParam;
 
 int handlerLiveData(UrlHandlerParam* param);
 int handlerControl(UrlHandlerParam* param);
+int handlerTimeouts(UrlHandlerParam* param);
 
 uint16_t hex2uint16(const char *p);
 
@@ -295,6 +297,7 @@ int handlerLogDelete(UrlHandlerParam* param)
 UrlHandler urlHandlerList[]={
     {"api/live", handlerLiveData},
     {"api/info", handlerInfo},
+    {"api/timeouts", handlerTimeouts},
 #if STORAGE != STORAGE_NONE
     {"api/list", handlerLogList},
     {"api/data", handlerLogData},
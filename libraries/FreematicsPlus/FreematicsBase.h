@@ -119,6 +119,9 @@
 #define PID_CSQ 0x81
 #define PID_DEVICE_TEMP 0x82
 #define PID_DEVICE_HALL 0x83
+#define PID_DTC_ECU 0x84 /* CAN ID of the ECU the next DTC change belongs to */
+#define PID_DTC 0x85 /* DTC set or status changed, code << 8 | status */
+#define PID_DTC_CLEARED 0x86 /* DTC no longer reported, code << 8 | status */
 #define PID_EXT_SENSOR1 0x90
 #define PID_EXT_SENSOR2 0x91
 
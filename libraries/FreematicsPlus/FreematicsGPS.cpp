@@ -22,6 +22,7 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 
 #include "FreematicsGPS.h"
+#include "FreematicsHex.h"
 
 #define _GPRMC_TERM   "GPRMC"
 #define _GPGGA_TERM   "GPGGA"
@@ -106,39 +107,6 @@ void TinyGPS::stats(unsigned short *sentences, unsigned short *failed_cs)
 //
 // internal utilities
 //
-byte TinyGPS::from_hex(char a)
-{
-  if (a >= 'A' && a <= 'F')
-    return a - 'A' + 10;
-  else if (a >= 'a' && a <= 'f')
-    return a - 'a' + 10;
-  else
-    return a - '0';
-}
-
-byte TinyGPS::hex2uint8(const char *p)
-{
-	byte c1 = *p;
-	byte c2 = *(p + 1);
-	if (c1 >= 'A' && c1 <= 'F')
-		c1 -= 7;
-	else if (c1 >= 'a' && c1 <= 'f')
-		c1 -= 39;
-	else if (c1 < '0' || c1 > '9')
-		return 0;
-
-	if (c2 == 0)
-		return (c1 & 0xf);
-	else if (c2 >= 'A' && c2 <= 'F')
-		c2 -= 7;
-	else if (c2 >= 'a' && c2 <= 'f')
-		c2 -= 39;
-	else if (c2 < '0' || c2 > '9')
-		return 0;
-
-	return c1 << 4 | (c2 & 0xf);
-}
-
 unsigned long TinyGPS::parse_decimal()
 {
   char *p = _term;
@@ -123,8 +123,6 @@ private:
 #endif
 
   // internal utilities
-  byte from_hex(char a);
-  byte hex2uint8(const char* p);
   unsigned long parse_decimal();
   unsigned long parse_degrees();
   bool term_complete();
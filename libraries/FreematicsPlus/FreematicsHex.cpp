@@ -0,0 +1,137 @@
+/*************************************************************************
+* Hexadecimal text decoding for adapter and NMEA replies
+* Distributed under BSD license
+* Visit https://freematics.com for more information
+*************************************************************************/
+
+#include <string.h>
+#include "FreematicsHex.h"
+
+#define H(c) ((c) >= '0' && (c) <= '9' ? (c) - '0' : (c) >= 'A' && (c) <= 'F' ? (c) - 'A' + 10 : (c) >= 'a' && (c) <= 'f' ? (c) - 'a' + 10 : -1)
+#define H4(c) H(c), H(c + 1), H(c + 2), H(c + 3)
+#define H16(c) H4(c), H4(c + 4), H4(c + 8), H4(c + 12)
+
+const int8_t hexDigitValue[256] = {
+	H16(0x00), H16(0x10), H16(0x20), H16(0x30), H16(0x40), H16(0x50), H16(0x60), H16(0x70),
+	H16(0x80), H16(0x90), H16(0xa0), H16(0xb0), H16(0xc0), H16(0xd0), H16(0xe0), H16(0xf0),
+};
+
+#undef H16
+#undef H4
+#undef H
+
+// Parses up to four hex characters (optionally with a space after the first byte) into a 16-bit value.
+uint16_t hex2uint16(const char *p)
+{
+	uint16_t i = 0;
+	for (uint8_t n = 0; n < 4; p++) {
+		int d = hexDigit(*p);
+		if (d < 0) {
+			if (*p == ' ' && n == 2) continue;
+			break;
+		}
+		i = (i << 4) | d;
+		n++;
+	}
+	return i;
+}
+
+// Parses two hex characters into an 8-bit value (0 on invalid input, one digit if the text ends).
+uint8_t hex2uint8(const char *p)
+{
+	int h = hexDigit(p[0]);
+	if (h < 0) return 0;
+	if (p[1] == 0) return h;
+	int l = hexDigit(p[1]);
+	return l < 0 ? 0 : (h << 4) | l;
+}
+
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define HEX_SWAR 1
+#endif
+
+#if HEX_SWAR
+#define ONES 0x01010101UL
+#define HIGHS 0x80808080UL
+
+// high bit set in every byte of v (all bytes < 0x80) that lies within [lo, hi]
+static inline uint32_t bytesInRange(uint32_t v, uint8_t lo, uint8_t hi)
+{
+	return (v + ONES * (0x80 - lo)) & ~(v + ONES * (0x7f - hi)) & HIGHS;
+}
+
+// Decodes the 12-character block "AA BB CC DD " into 4 bytes; false if the block has any other shape.
+static inline bool decodeHexBlock(const char* p, uint8_t* out)
+{
+	// little-endian: text position 0 is the lowest byte of the first word
+	static const uint32_t spaces[3] = {0x00800000UL, 0x00008000UL, 0x80000080UL};
+	uint32_t w[3];
+	uint8_t nib[12];
+	memcpy(w, p, sizeof(w));
+	for (int i = 0; i < 3; i++) {
+		uint32_t x = w[i];
+		if (x & HIGHS) return false;
+		uint32_t y = x | ONES * 0x20; // folds 'A'-'F' onto 'a'-'f'
+		uint32_t digit = bytesInRange(x, '0', '9');
+		uint32_t alpha = bytesInRange(y, 'a', 'f');
+		if (bytesInRange(x, ' ', ' ') != spaces[i] || (digit | alpha) != (HIGHS & ~spaces[i])) return false;
+		uint32_t n = (x & ONES * 0x0f) + (alpha >> 7) * 9;
+		memcpy(nib + i * 4, &n, 4);
+	}
+	out[0] = nib[0] << 4 | nib[1];
+	out[1] = nib[3] << 4 | nib[4];
+	out[2] = nib[6] << 4 | nib[7];
+	out[3] = nib[9] << 4 | nib[10];
+	return true;
+}
+#endif
+
+// Decodes space or comma separated hex byte pairs, four at a time where the text allows it.
+int decodeHexBytes(const char* p, const char* end, uint8_t* out, int outSize, const char** stop)
+{
+	int n = 0;
+	for (;;) {
+#if HEX_SWAR
+		while (end - p >= 12 && outSize - n >= 4 && decodeHexBlock(p, out + n)) {
+			p += 12;
+			n += 4;
+		}
+#endif
+		while (p < end && (*p == ' ' || *p == ',')) p++;
+		if (p >= end) break;
+		int v = end - p >= 2 ? hexByte(p) : -1;
+		if (v < 0 || n >= outSize) {
+			if (!stop) return -1;
+			break;
+		}
+		out[n++] = v;
+		p += 2;
+	}
+	if (stop) *stop = p;
+	return n;
+}
+
+// Decodes the 3-digit, 8-digit or four-pair CAN ID at the start of a headers-on line.
+int decodeCanHeader(const char* p, const char* end, uint32_t* id)
+{
+	int n = 0;
+	while (p + n < end && hexDigit(p[n]) >= 0) n++;
+	if (p + n >= end || (p[n] != ' ' && p[n] != ',')) return 0;
+	uint32_t v = 0;
+	if (n == 3 || n == 8) {
+		for (int i = 0; i < n; i++) v = (v << 4) | hexDigit(p[i]);
+	} else if (n == 2 && end - p > 11) {
+		// "18 DA F1 10 ": the four bytes of a 29-bit ID
+		for (n = 0; n < 12; n += 3) {
+			int b = hexByte(p + n);
+			if (b < 0 || p[n + 2] != ' ') return 0;
+			v = (v << 8) | b;
+		}
+		n = 11;
+		if (v > 0x1FFFFFFF) return 0;
+	} else {
+		return 0;
+	}
+	*id = v;
+	return n;
+}
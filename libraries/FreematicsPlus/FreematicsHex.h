@@ -0,0 +1,88 @@
+/*************************************************************************
+* Hexadecimal text decoding for adapter and NMEA replies
+* Distributed under BSD license
+* Visit https://freematics.com for more information
+*************************************************************************/
+
+#ifndef FREEMATICS_HEX
+#define FREEMATICS_HEX
+
+#include <stdint.h>
+
+/**
+ * @brief Value of every character as a hex digit, -1 for non-hex characters.
+ */
+extern const int8_t hexDigitValue[256];
+
+/**
+ * @brief Decodes one hex digit.
+ * @param c Character to decode.
+ * @return Digit value 0-15, or -1 if @p c is not a hex digit.
+ */
+static inline int hexDigit(char c)
+{
+	return hexDigitValue[(uint8_t)c];
+}
+
+/**
+ * @brief Decodes two hex digits into a byte.
+ * @param p Pointer to at least two readable characters (a terminator stops the scan).
+ * @return Byte value 0-255, or -1 if either character is not a hex digit.
+ */
+static inline int hexByte(const char* p)
+{
+	int h = hexDigit(p[0]);
+	if (h < 0) return -1;
+	int l = hexDigit(p[1]);
+	return l < 0 ? -1 : (h << 4) | l;
+}
+
+/**
+ * @brief Converts up to four hexadecimal characters into a 16-bit unsigned integer.
+ *
+ * One space after the first two digits is skipped ("0C 1A"). Parsing stops
+ * at the first other non-hex character.
+ *
+ * @param p Pointer to a character sequence that starts with hexadecimal data.
+ * @return Parsed 16-bit value.
+ */
+uint16_t hex2uint16(const char *p);
+/**
+ * @brief Converts one or two hexadecimal characters into an 8-bit unsigned integer.
+ * @param p Pointer to a character sequence that starts with hexadecimal data.
+ * @return Parsed 8-bit value, or 0 for invalid input.
+ */
+uint8_t hex2uint8(const char *p);
+/**
+ * @brief Decodes a run of hex byte pairs separated by spaces or commas ("AA BB CC").
+ *
+ * Aligned "AA BB CC DD " blocks are decoded four bytes at a time with
+ * word-wide (SWAR) classification; everything else goes through hexByte().
+ * @p out may alias the input text, since output never overtakes input.
+ *
+ * @param p Start of the text.
+ * @param end End of the text (exclusive).
+ * @param out Output buffer for the decoded bytes.
+ * @param outSize Capacity of @p out.
+ * @param stop If null, any text that is not a byte pair or a full @p out fails
+ *             the whole run. Otherwise decoding stops there and @p stop
+ *             receives the position.
+ * @return Number of bytes decoded, or -1 on invalid text in strict mode.
+ */
+int decodeHexBytes(const char* p, const char* end, uint8_t* out, int outSize, const char** stop = 0);
+/**
+ * @brief Decodes the CAN ID an adapter prints ahead of each frame with headers on (ATH1).
+ *
+ * Accepts an 11-bit ID ("7E8 03 ..."), a 29-bit ID as one token
+ * ("18DAF110 03 ...") or, with spaces on (ATS1), as four byte pairs
+ * ("18 DA F1 10 03 ..."). The ID must be followed by a space or a comma.
+ * Only meaningful with headers on: a headerless line may pass for a 29-bit ID.
+ *
+ * @param p Start of the line.
+ * @param end End of the line (exclusive).
+ * @param id Receives the CAN ID.
+ * @return Number of characters taken by the ID, 0 if the line does not start with one.
+ */
+int decodeCanHeader(const char* p, const char* end, uint32_t* id);
+
+#endif
@@ -26,64 +26,112 @@ int dumpLine(char* buffer, int len)
 	return bytesToDump;
 }
 
-// Parses up to four hex characters (optionally with spaces) into a 16-bit value.
-uint16_t hex2uint16(const char *p)
-{
-	char c = *p;
-	uint16_t i = 0;
-	for (uint8_t n = 0; c && n < 4; c = *(++p)) {
-		if (c >= 'A' && c <= 'F') {
-			c -= 7;
-		} else if (c>='a' && c<='f') {
-			c -= 39;
-        } else if (c == ' ' && n == 2) {
-            continue;
-        } else if (c < '0' || c > '9') {
-			break;
-        }
-		i = (i << 4) | (c & 0xF);
-		n++;
+/*************************************************************************
+* Adapter reply scanning
+*************************************************************************/
+
+static const char* const linkErrorTokens[] = {"UNABLE", "ERROR", "TIMEOUT", "NO DATA", "STOPPED", "BUFFER FULL", "?"};
+#define LINK_TOKEN_COUNT (sizeof(linkErrorTokens) / sizeof(linkErrorTokens[0]))
+
+// Shift-And masks over the concatenated tokens: bit j of mask[c] is set when
+// character j of the concatenation is c; start/end mark each token's first/last bit
+static struct LinkTokenMasks {
+	uint64_t mask[128];
+	uint64_t start;
+	uint64_t end[LINK_TOKEN_COUNT];
+	uint64_t anyEnd;
+	LinkTokenMasks()
+	{
+		memset(this, 0, sizeof(*this));
+		byte bit = 0;
+		for (byte i = 0; i < LINK_TOKEN_COUNT; i++) {
+			const char* token = linkErrorTokens[i];
+			start |= 1ULL << bit;
+			for (; *token; token++, bit++) mask[(byte)*token] |= 1ULL << bit;
+			end[i] = 1ULL << (bit - 1);
+			anyEnd |= end[i];
+		}
 	}
-	return i;
+} linkTokens;
+
+// Clears prompt, ellipsis and error token match state.
+void CLinkParser::reset()
+{
+	m_state = 0;
+	m_dots = 0;
+	m_error = 0;
+	m_searching = false;
+	m_last = 0;
 }
 
-// Parses two hex characters into an 8-bit value (0 on invalid input).
-byte hex2uint8(const char *p)
+// Advances all token matchers by one character at once; returns true on "\r>".
+bool CLinkParser::feed(char c)
 {
-	byte c1 = *p;
-	byte c2 = *(p + 1);
-	if (c1 >= 'A' && c1 <= 'F')
-		c1 -= 7;
-	else if (c1 >= 'a' && c1 <= 'f')
-		c1 -= 39;
-	else if (c1 < '0' || c1 > '9')
-		return 0;
+	bool prompt = (c == '>' && (m_last == '\r' || m_last == '\n' || m_last == 0));
+	m_last = c;
+	if (c == '.') {
+		if (++m_dots == 3) m_searching = true;
+	} else {
+		m_dots = 0;
+	}
+	if (m_error) return prompt;
+	m_state = ((m_state << 1) | linkTokens.start) & ((byte)c < 128 ? linkTokens.mask[(byte)c] : 0);
+	if (m_state & linkTokens.anyEnd) {
+		for (byte i = 0; i < LINK_TOKEN_COUNT; i++) {
+			if (m_state & linkTokens.end[i]) {
+				m_error = i + 1;
+				break;
+			}
+		}
+	}
+	return prompt;
+}
 
-	if (c2 == 0)
-		return (c1 & 0xf);
-	else if (c2 >= 'A' && c2 <= 'F')
-		c2 -= 7;
-	else if (c2 >= 'a' && c2 <= 'f')
-		c2 -= 39;
-	else if (c2 < '0' || c2 > '9')
-		return 0;
+// Returns and clears the "..." detection flag.
+bool CLinkParser::searching()
+{
+	bool searching = m_searching;
+	m_searching = false;
+	return searching;
+}
 
-	return c1 << 4 | (c2 & 0xf);
+// Returns the next non-empty line as a pointer/length pair into the buffer.
+bool CLineIterator::next(const char*& line, int& len)
+{
+	while (m_pos < m_end && (*m_pos == '\r' || *m_pos == '\n')) m_pos++;
+	if (m_pos >= m_end || !*m_pos) return false;
+	line = m_pos;
+	while (m_pos < m_end && *m_pos && *m_pos != '\r' && *m_pos != '\n') m_pos++;
+	len = m_pos - line;
+	return true;
 }
 
 /*************************************************************************
 * OBD-II UART Bridge
 *************************************************************************/
 
+// Copies the first non-empty line of an adapter reply, without prompt.
+static void copyFirstLine(char* dest, const char* src, int size)
+{
+	while (*src == '\r' || *src == '\n') src++;
+	int n = 0;
+	for (; n < size - 1 && src[n] && src[n] != '\r' && src[n] != '\n' && src[n] != '>'; n++) dest[n] = src[n];
+	dest[n] = 0;
+}
+
 // Reads a PID value, normalizes the data, and writes the result to result.
 bool COBD::readPID(byte pid, int& result)
 {
 	char buffer[64];
 	char* data = 0;
 	sprintf(buffer, "%02X%02X\r", dataMode, pid);
+	flushStale();
 	link->send(buffer);
 	idleTasks();
-	int ret = link->receive(buffer, sizeof(buffer), OBD_TIMEOUT_SHORT);
+	uint32_t canId = requestCANID();
+	uint32_t t = millis();
+	int ret = link->receive(buffer, sizeof(buffer), getTimeout(canId, dataMode, OBD_TIMEOUT_SHORT));
+	t = millis() - t;
 	if (ret > 0 && !checkErrorMessage(buffer)) {
 		char *p = buffer;
 		while ((p = strstr(p, "41 "))) {
@@ -101,6 +149,7 @@ bool COBD::readPID(byte pid, int& result)
 		}
 	}
 
+	recordLatency(canId, dataMode, t, data != 0);
 	if (!data) {
 		errors++;
 		return false;
@@ -109,18 +158,150 @@ bool COBD::readPID(byte pid, int& result)
 	return true;
 }
 
-// Reads multiple PIDs and returns how many were read successfully.
-byte COBD::readPID(const byte pid[], byte count, int result[])
+// Reads multiple PIDs in batches and returns how many were read successfully.
+byte COBD::readPID(const byte pid[], byte count, int result[], bool success[])
 {
+	bool status[OBD_MAX_PIDS_PER_REQUEST];
+	byte results = 0;
+	for (byte n = 0; n < count; n += OBD_MAX_PIDS_PER_REQUEST) {
+		byte batch = count - n;
+		if (batch > OBD_MAX_PIDS_PER_REQUEST) batch = OBD_MAX_PIDS_PER_REQUEST;
+		results += readPIDBatch(pid + n, batch, result + n, status);
+		if (success) memcpy(success + n, status, batch * sizeof(bool));
+	}
+	return results;
+}
+
+// Sends one request carrying several PIDs (e.g. "010D0C11") and decodes all PIDs found in the reply.
+byte COBD::readPIDBatch(const byte pid[], byte count, int result[], bool success[])
+{
+	/*
+	Response examples:
+	41 0D 00 0C 0B B8 11 20
+	or
+	00A
+	0: 41 0D 00 0C 0B B8
+	1: 11 20 04 33 00 00 00
+	*/
+	char buffer[192];
 	byte results = 0;
+	for (byte n = 0; n < count; n++) success[n] = false;
+	if (!link || count == 0) return 0;
+
+	int len = sprintf(buffer, "%02X", dataMode);
 	for (byte n = 0; n < count; n++) {
-		if (readPID(pid[n], result[n])) {
+		len += sprintf(buffer + len, "%02X", pid[n]);
+	}
+	buffer[len++] = '\r';
+	buffer[len] = 0;
+	flushStale();
+	link->send(buffer);
+	idleTasks();
+	uint32_t canId = requestCANID();
+	uint32_t t = millis();
+	int ret = link->receive(buffer, sizeof(buffer), getTimeout(canId, dataMode, OBD_TIMEOUT_SHORT));
+	t = millis() - t;
+	if (ret > 0 && !checkErrorMessage(buffer)) {
+		results = parsePIDReply(buffer, ret, pid, count, result, success);
+	}
+	recordLatency(canId, dataMode, t, results != 0);
+
+	if (results) {
+		errors = 0;
+	} else {
+		errors++;
+	}
+	return results;
+}
+
+// Splits a reply into per-ECU messages, joining the numbered lines of multi-frame replies, and decodes each.
+byte COBD::parsePIDReply(const char* buffer, int len, const byte pid[], byte count, int result[], bool success[])
+{
+	byte msg[64];
+	int msgLen = 0;
+	// byte count announced by a multi-frame header, -1 for a single-frame reply
+	int announced = -1;
+	byte results = 0;
+	CLineIterator lines(buffer, len);
+	const char* line;
+	int lineLen;
+	while (lines.next(line, lineLen)) {
+		const char *eol = line + lineLen;
+		const char *colon = (const char*)memchr(line, ':', lineLen);
+		const char *q = line;
+		if (colon) {
+			// numbered lines of a multi-frame reply are appended to the current message
+			q = colon + 1;
+		} else {
+			// a single-frame reply (one per responding ECU) or the byte count header of a multi-frame reply
+			// the last frame is padded, so only the announced bytes are parsed
+			if (announced >= 0 && announced < msgLen) msgLen = announced;
+			results += parsePIDMessage(msg, msgLen, pid, count, result, success);
+			msgLen = 0;
+			announced = -1;
+			if (lineLen <= 3) {
+				announced = 0;
+				for (int i = 0; i < lineLen && hexDigit(line[i]) >= 0; i++) announced = (announced << 4) | hexDigit(line[i]);
+				q = eol;
+			}
+		}
+		msgLen += decodeHexBytes(q, eol, msg + msgLen, sizeof(msg) - msgLen, &q);
+	}
+	if (announced >= 0 && announced < msgLen) msgLen = announced;
+	results += parsePIDMessage(msg, msgLen, pid, count, result, success);
+	return results;
+}
+
+// Walks "41 <pid> <data> <pid> <data> ..." and normalizes every requested PID found.
+byte COBD::parsePIDMessage(const byte* msg, int len, const byte pid[], byte count, int result[], bool success[])
+{
+	byte results = 0;
+	if (len < 2 || msg[0] != 0x40 + dataMode) return 0;
+	for (int i = 1; i < len; ) {
+		byte curpid = msg[i++];
+		byte n;
+		for (n = 0; n < count && pid[n] != curpid; n++);
+		byte bytes = getPIDDataLength(curpid);
+		if (n == count || bytes == 0 || i + bytes > len) break;
+		// normalizeData() works on the adapter's text format ("AA BB ...")
+		char data[OBD_MAX_PID_DATA_BYTES * 3 + 1];
+		for (byte m = 0; m < bytes; m++) {
+			sprintf(data + m * 3, "%02X ", msg[i + m]);
+		}
+		data[bytes * 3 - 1] = 0;
+		i += bytes;
+		if (!success[n]) {
+			result[n] = normalizeData(curpid, data);
+			success[n] = true;
 			results++;
 		}
 	}
 	return results;
 }
 
+// Returns the number of data bytes a mode 01 PID carries (SAE J1979), 0 if unknown.
+byte COBD::getPIDDataLength(byte pid)
+{
+	static const byte lengths[0x70] = {
+		4, 4, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 1, 1, 1, // 0x00
+		2, 1, 1, 1, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, // 0x10
+		4, 2, 2, 2, 4, 4, 4, 4, 4, 4, 4, 4, 1, 1, 1, 1, // 0x20
+		1, 2, 2, 1, 4, 4, 4, 4, 4, 4, 4, 4, 2, 2, 2, 2, // 0x30
+		4, 4, 2, 2, 2, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 4, // 0x40
+		4, 1, 1, 2, 2, 2, 2, 2, 2, 2, 1, 1, 1, 2, 2, 1, // 0x50
+		4, 1, 1, 2, 5, 2, 5, 3, 7, 7, 5, 5, 5, 11, 9, 3, // 0x60
+	};
+	if (pid < sizeof(lengths)) return lengths[pid];
+	switch (pid) {
+	case 0x80:
+	case 0xA0:
+	case 0xC0:
+	case PID_ODOMETER:
+		return 4;
+	}
+	return 0;
+}
+
 // Retrieves DTC codes and fills codes with up to maxCodes entries.
 int COBD::readDTC(uint16_t codes[], byte maxCodes)
 {
@@ -134,8 +315,13 @@ int COBD::readDTC(uint16_t codes[], byte maxCodes)
  	for (int n = 0; n < 6; n++) {
 		char buffer[128];
 		sprintf(buffer, n == 0 ? "03\r" : "03%02X\r", n);
+		flushStale();
 		link->send(buffer);
-		if (link->receive(buffer, sizeof(buffer), OBD_TIMEOUT_LONG) > 0) {
+		uint32_t canId = requestCANID();
+		uint32_t t = millis();
+		int ret = link->receive(buffer, sizeof(buffer), getTimeout(canId, 0x03, OBD_TIMEOUT_LONG));
+		recordLatency(canId, 0x03, millis() - t, ret > 0 && !strstr(buffer, "NO DATA"));
+		if (ret > 0) {
 			if (!strstr(buffer, "NO DATA")) {
 				char *p = strstr(buffer, "43");
 				if (p) {
@@ -297,6 +483,7 @@ void COBD::leaveLowPowerMode()
 	char buf[32];
 	if (!link) return;
 	for (byte n = 0; n < 30 && !link->sendCommand("ATI\r", buf, sizeof(buf), 1000); n++);
+	invalidateHeaderState();
 }
 
 // Returns a pointer to the first numeric value in the response text.
@@ -357,20 +544,62 @@ bool COBD::getVIN(char* buffer, byte bufsize)
     return false;
 }
 
-// Checks the PID against the pidmap loaded during initialization.
+// Checks the PID against the discovered pidmap; every PID is accepted until a map is known.
 bool COBD::isValidPID(byte pid)
 {
+	if (!m_pidmapValid) return true;
 	pid--;
 	byte i = pid >> 3;
 	byte b = 0x80 >> (pid & 0x7);
 	return (pidmap[i] & b) != 0;
 }
 
+// Queries the supported PID ranges and merges the bitmaps reported by all ECUs.
+bool COBD::loadPIDMap()
+{
+	char buffer[128];
+	bool success = false;
+	if (!link) return false;
+	memset(pidmap, 0, sizeof(pidmap));
+	for (byte i = 0; i < 8; i++) {
+		byte pid = i * 0x20;
+		sprintf(buffer, "%02X%02X\r", dataMode, pid);
+		flushStale();
+		link->send(buffer);
+		idleTasks();
+		if (link->receive(buffer, sizeof(buffer), OBD_TIMEOUT_LONG) <= 0 || checkErrorMessage(buffer)) {
+			break;
+		}
+		for (char *p = buffer; (p = strstr(p, "41 ")); ) {
+			p += 3;
+			if (hex2uint8(p) == pid) {
+				p += 2;
+				for (byte n = 0; n < 4 && *(p + n * 3) == ' '; n++) {
+					pidmap[i * 4 + n] |= hex2uint8(p + n * 3 + 1);
+				}
+				success = true;
+			}
+		}
+		// the last bit of each range tells whether the next range is supported
+		if (!(pidmap[i * 4 + 3] & 1)) break;
+	}
+	if (success) m_pidmapValid = true;
+	return success;
+}
+
+// Sets pidmap from a cached map.
+void COBD::setPIDMap(const byte* map)
+{
+	memcpy(pidmap, map, sizeof(pidmap));
+	m_pidmapValid = true;
+}
+
 // Initializes the OBD adapter, tests communication, and loads the PID map.
 bool COBD::init(OBD_PROTOCOLS protocol, bool quick)
 {
 	const char *initcmd[] = {"ATE0\r", "ATH0\r", "ATCAF1\r", "ATCFC1\r"};
 	char buffer[64];
+	char adapter[sizeof(m_warm->adapter)] = {0};
 	bool success = false;
 
 	Serial.println("[OBD:init] Step 1/7: Check link");
@@ -382,7 +611,15 @@ bool COBD::init(OBD_PROTOCOLS protocol, bool quick)
 
 	Serial.println("[OBD:init] Step 2/7: Set state to DISCONNECTED");
 	m_state = OBD_DISCONNECTED;
+	invalidateHeaderState();
 	Serial.println("[OBD:init] Step 2/7: State - OK");
+	m_warmStarted = warmStart(protocol);
+	if (m_warmStarted) {
+		Serial.println("[OBD:init] Warm start: adapter state cached - OK");
+		m_state = OBD_CONNECTED;
+		errors = 0;
+		return true;
+	}
 	Serial.println("[OBD:init] Step 3/7: Reset adapter (ATZ)");
 	for (byte n = 0; n < 3; n++) {
 		if (link->sendCommand("ATZ\r", buffer, sizeof(buffer), OBD_TIMEOUT_SHORT)) {
@@ -401,6 +638,7 @@ bool COBD::init(OBD_PROTOCOLS protocol, bool quick)
 	if (link->sendCommand("ATI\r", buffer, sizeof(buffer), OBD_TIMEOUT_SHORT)) {
 		Serial.print("[OBD:init] ATI response: ");
 		Serial.println(buffer);
+		copyFirstLine(adapter, buffer, sizeof(adapter));
 	} else {
 		Serial.println("[OBD:init] ATI response: (none)");
 	}
@@ -408,6 +646,9 @@ bool COBD::init(OBD_PROTOCOLS protocol, bool quick)
 	for (byte i = 0; i < sizeof(initcmd) / sizeof(initcmd[0]); i++) {
 		link->sendCommand(initcmd[i], buffer, sizeof(buffer), OBD_TIMEOUT_SHORT);
 	}
+	// ATCFC1 is the last init command
+	if (strstr(buffer, "OK")) m_flowControl = 1;
+	m_headers = 0;
 	Serial.println("[OBD:init] Step 4/7: (ATE0/ATH0/ATCAF1/ATCFC1) - OK");
 	if (protocol != PROTO_AUTO) {
 		Serial.println("[OBD:init] Step 5/7: Set protocol (ATSP)");
@@ -422,6 +663,7 @@ bool COBD::init(OBD_PROTOCOLS protocol, bool quick)
 		Serial.println("[OBD:init] Step 6/7: J1939 fast-path");
 		m_state = OBD_CONNECTED;
 		errors = 0;
+		saveWarmState(protocol, adapter);
 		Serial.println("[OBD:init] Step 6/7: OK");
 		return true;
 	}
@@ -475,6 +717,7 @@ success = true;
 	if (success) {
 		m_state = OBD_CONNECTED;
 		errors = 0;
+		saveWarmState(protocol, adapter);
 		Serial.println("[OBD:init] Step 7/7: OK");
 	} else {
 		Serial.println("[OBD:init] Step 7/7: FAIL (PID map)");
@@ -482,11 +725,88 @@ success = true;
 	return success;
 }
 
+// Runs one recovery step: resync the link, reopen the protocol or fully re-init.
+bool COBD::recover(OBD_RECOVERY level, OBD_PROTOCOLS protocol)
+{
+	char buffer[64];
+	if (!link) return false;
+	bool success = false;
+	switch (level) {
+	case OBD_RECOVER_RESYNC:
+		// drop a late or partial reply, then check the adapter is back at its prompt
+		for (int n = 0; n < 256 && link->read() >= 0; n++);
+		m_stale = false;
+		success = link->sendCommand("ATI\r", buffer, sizeof(buffer), OBD_TIMEOUT_SHORT) > 0;
+		break;
+	case OBD_RECOVER_PROTOCOL:
+		link->sendCommand("ATPC\r", buffer, sizeof(buffer), OBD_TIMEOUT_SHORT);
+		invalidateHeaderState();
+		sprintf(buffer, "ATSP %X\r", protocol);
+		success = link->sendCommand(buffer, buffer, sizeof(buffer), OBD_TIMEOUT_SHORT) && strstr(buffer, "OK");
+		break;
+	case OBD_RECOVER_RESET:
+		invalidateWarmState();
+		return init(protocol);
+	}
+	if (success) errors = 0;
+	return success;
+}
+
+// Probes the adapter with ATI; the cached state holds if the reply is the cached ID without echo.
+bool COBD::warmStart(OBD_PROTOCOLS protocol)
+{
+	if (!m_warm || m_warm->magic != OBD_WARM_MAGIC || m_warm->protocol != protocol || !m_warm->adapter[0]) return false;
+	char buffer[64];
+	char adapter[sizeof(m_warm->adapter)];
+	if (!link->sendCommand("ATI\r", buffer, sizeof(buffer), OBD_TIMEOUT_SHORT)) return false;
+	// an echoed "ATI" means the adapter was reset and lost ATE0 and the rest of the init commands
+	copyFirstLine(adapter, buffer, sizeof(adapter));
+	if (strcmp(adapter, m_warm->adapter)) {
+		Serial.print("[OBD:init] Warm start mismatch: ");
+		Serial.println(adapter);
+		m_warm->magic = 0;
+		return false;
+	}
+	m_flowControl = m_warm->flowControl;
+	// the adapter may still be addressing the ECU of the last UDS read
+	setHeaders(false);
+	setCANID(0x7DF);
+	setHeaderMask(0x7F8);
+	setHeaderFilter(0x7E8);
+	return true;
+}
+
+// Records the state negotiated by a full init in the warm-start cache.
+void COBD::saveWarmState(OBD_PROTOCOLS protocol, const char* adapter)
+{
+	if (!m_warm) return;
+	m_warm->protocol = protocol;
+	m_warm->flowControl = m_flowControl;
+	strncpy(m_warm->adapter, adapter, sizeof(m_warm->adapter) - 1);
+	m_warm->adapter[sizeof(m_warm->adapter) - 1] = 0;
+	m_warm->magic = OBD_WARM_MAGIC;
+}
+
+// Keys the warm-start cache to a vehicle; false if a warm start was taken for another VIN.
+bool COBD::checkWarmVIN(const char* vin)
+{
+	if (!m_warm || !vin || !*vin) return true;
+	bool other = m_warm->vin[0] && strncmp(m_warm->vin, vin, sizeof(m_warm->vin) - 1);
+	strncpy(m_warm->vin, vin, sizeof(m_warm->vin) - 1);
+	m_warm->vin[sizeof(m_warm->vin) - 1] = 0;
+	if (other && m_warmStarted) {
+		m_warm->magic = 0;
+		return false;
+	}
+	return true;
+}
+
 // Soft-resets the adapter (ATR).
 void COBD::reset()
 {
 	char buf[32];
 	if (link) link->sendCommand("ATR\r", buf, sizeof(buf), OBD_TIMEOUT_SHORT);
+	invalidateHeaderState();
 }
 
 // Ends the OBD session (ATPC).
@@ -539,9 +859,124 @@ void COBD::setHeaderID(uint32_t num)
 		link->sendCommand(buf, buf, sizeof(buf), 1000);
 		sprintf(buf, "ATCP %X\r", num & 0x1f);
 		link->sendCommand(buf, buf, sizeof(buf), 1000);
+		// ATSH here carries different bits than setCANID(), so its cache no longer applies
+		m_canId = OBD_HEADER_UNKNOWN;
 	}
 }
 
+// Sends a header/filter AT command and reports whether the adapter acknowledged it.
+bool COBD::sendHeaderCommand(const char* cmd)
+{
+	char buf[32];
+	return link->sendCommand(cmd, buf, sizeof(buf), 1000) && strstr(buf, "OK");
+}
+
+// Forgets all cached adapter header state.
+void COBD::invalidateHeaderState()
+{
+	m_canId = OBD_HEADER_UNKNOWN;
+	m_headerMask = OBD_HEADER_UNKNOWN;
+	m_headerFilter = OBD_HEADER_UNKNOWN;
+	m_flowControl = -1;
+	m_headers = -1;
+}
+
+// Upper bounds (ms) of the latency histogram buckets; slower responses land in the last one.
+static const uint16_t latencyBins[OBD_LATENCY_BINS] = {25, 50, 75, 100, 150, 200, 300, 500, 750, 1000, 2000, 5000};
+
+// Returns the learned timeout for a CAN ID/service, or the fallback when nothing reliable is known.
+unsigned int COBD::getTimeout(uint32_t canId, byte service, unsigned int fallback)
+{
+	for (byte i = 0; i < m_latencyCount; i++) {
+		OBD_LATENCY& l = m_latency[i];
+		if (l.canId != canId || l.service != service) continue;
+		if (!l.timeout || l.misses >= OBD_LATENCY_MISSES || l.timeout > fallback) break;
+		return l.timeout;
+	}
+	return fallback;
+}
+
+// Adds a response to the histogram of its CAN ID/service and re-derives the timeout.
+void COBD::recordLatency(uint32_t canId, byte service, unsigned int elapsed, bool responded)
+{
+	OBD_LATENCY* l = 0;
+	for (byte i = 0; i < m_latencyCount && !l; i++) {
+		if (m_latency[i].canId == canId && m_latency[i].service == service) l = m_latency + i;
+	}
+	if (!l) {
+		if (m_latencyCount < OBD_LATENCY_SLOTS) {
+			l = m_latency + m_latencyCount++;
+		} else {
+			// replace the entry with the least history
+			l = m_latency;
+			for (byte i = 1; i < m_latencyCount; i++) {
+				if (m_latency[i].samples < l->samples) l = m_latency + i;
+			}
+		}
+		memset(l, 0, sizeof(OBD_LATENCY));
+		l->canId = canId;
+		l->service = service;
+	}
+	if (!responded) {
+		if (l->misses < 0xff) l->misses++;
+		// a reply may still arrive after we gave up on it
+		m_stale = true;
+		return;
+	}
+	l->misses = 0;
+	byte bin = 0;
+	while (bin < OBD_LATENCY_BINS - 1 && elapsed > latencyBins[bin]) bin++;
+	l->bins[bin]++;
+	if (++l->samples >= 256) {
+		// age the histogram so the timeout follows changing bus conditions
+		l->samples = 0;
+		for (byte i = 0; i < OBD_LATENCY_BINS; i++) {
+			l->bins[i] >>= 1;
+			l->samples += l->bins[i];
+		}
+	}
+	if (l->samples < OBD_LATENCY_MIN_SAMPLES) return;
+	// 95th percentile bucket bound, scaled by 1.5 plus a fixed margin
+	uint16_t threshold = l->samples - l->samples / 20;
+	uint16_t sum = 0;
+	for (bin = 0; bin < OBD_LATENCY_BINS - 1; bin++) {
+		sum += l->bins[bin];
+		if (sum >= threshold) break;
+	}
+	unsigned int timeout = latencyBins[bin] * 3 / 2 + OBD_LATENCY_MARGIN;
+	l->timeout = timeout < OBD_TIMEOUT_MIN ? OBD_TIMEOUT_MIN : timeout;
+}
+
+// Drains whatever a timed out request left in the link.
+void COBD::flushStale()
+{
+	if (!m_stale || !link) return;
+	m_stale = false;
+	for (int n = 0; n < 256 && link->read() >= 0; n++);
+}
+
+// Sets adapter flow control (ATCFC) unless it is already in the requested state.
+bool COBD::setFlowControl(bool enabled)
+{
+	if (!link) return false;
+	if (m_flowControl == (int8_t)enabled) return true;
+	m_flowControl = -1;
+	if (!sendHeaderCommand(enabled ? "ATCFC1\r" : "ATCFC0\r")) return false;
+	m_flowControl = enabled;
+	return true;
+}
+
+// Turns CAN IDs in replies on or off (ATH1/ATH0) unless already in the requested state.
+bool COBD::setHeaders(bool enabled)
+{
+	if (!link) return false;
+	if (m_headers == (int8_t)enabled) return true;
+	m_headers = -1;
+	if (!sendHeaderCommand(enabled ? "ATH1\r" : "ATH0\r")) return false;
+	m_headers = enabled;
+	return true;
+}
+
 // Enables or disables CAN sniffing.
 void COBD::sniff(bool enabled)
 {
@@ -551,23 +986,23 @@ void COBD::sniff(bool enabled)
 	}
 }
 
-// Sets the CAN header filter for sniffing.
+// Sets the CAN header filter for sniffing (skipped when unchanged).
 void COBD::setHeaderFilter(uint32_t num)
 {
-	if (link) {
+	if (link && num != m_headerFilter) {
 		char buf[32];
-		sprintf(buf, "ATCF %X\r", num);
-		link->sendCommand(buf, buf, sizeof(buf), 1000);
+		sprintf(buf, num > 0x7FF ? "ATCF %08X\r" : "ATCF %03X\r", num);
+		m_headerFilter = sendHeaderCommand(buf) ? num : OBD_HEADER_UNKNOWN;
 	}
 }
 	
-// Sets the CAN header mask for sniffing.
+// Sets the CAN header mask for sniffing (skipped when unchanged).
 void COBD::setHeaderMask(uint32_t bitmask)
 {
-	if (link) {
+	if (link && bitmask != m_headerMask) {
 		char buf[32];
-		sprintf(buf, "ATCM %X\r", bitmask);
-		link->sendCommand(buf, buf, sizeof(buf), 1000);
+		sprintf(buf, bitmask > 0x7FF ? "ATCM %08X\r" : "ATCM %03X\r", bitmask);
+		m_headerMask = sendHeaderCommand(buf) ? bitmask : OBD_HEADER_UNKNOWN;
 	}
 }
 
@@ -604,33 +1039,122 @@ int COBD::receiveData(byte* buf, int len)
 		for (; tokenEnd < len && buf[tokenEnd] != ' ' && buf[tokenEnd] != '\r'; tokenEnd++) {}
 		if (tokenEnd > 2 && tokenEnd < len && buf[tokenEnd] == ' ') {
 			bool allHex = true;
-			for (int i = 0; i < tokenEnd; i++) {
-				char c = buf[i];
-				if (!((c >= '0' && c <= '9') || (c >= 'A' && c <= 'F') || (c >= 'a' && c <= 'f'))) {
-					allHex = false;
-					break;
-				}
-			}
+			for (int i = 0; i < tokenEnd && allHex; i++) allHex = hexDigit(buf[i]) >= 0;
 			if (allHex && (tokenEnd == 3 || tokenEnd == 8)) {
 				start = tokenEnd + 1;
 			}
 		}
-		for (n = start; n < len; bytes++) {
-			buf[bytes] = hex2uint8((const char*)buf + n);
-			n += 2;
-			if (buf[n++] != ' ') break;
-		}
+		const char* stop;
+		bytes = decodeHexBytes((const char*)buf + start, (const char*)buf + len, buf, len, &stop);
 	}
 	return bytes;
 }
 
-// Sets the CAN ID for transmitting upcoming frames.
-void COBD::setCANID(uint16_t id)
+// Programs filter/mask for the ID list and starts monitoring with headers on.
+bool COBD::startMonitor(const uint32_t ids[], byte count)
 {
-	if (link) {
+	if (!link || !count) return false;
+	// one ATCF/ATCM pair matches either 11-bit or 29-bit IDs, not both
+	uint32_t width = ids[0] > 0x7FF ? 0x1FFFFFFF : 0x7FF;
+	uint32_t diff = 0;
+	for (byte i = 1; i < count; i++) {
+		if ((ids[i] > 0x7FF) != (width > 0x7FF)) return false;
+		diff |= ids[i] ^ ids[0];
+	}
+	// keep only the bits all IDs agree on
+	uint32_t mask = ~diff & width;
+	m_pollMask = m_headerMask;
+	m_pollFilter = m_headerFilter;
+	setHeaderMask(mask);
+	setHeaderFilter(ids[0] & mask);
+	if (!setHeaders(true)) return false;
+	m_monitorIds = ids;
+	m_monitorCount = count;
+	// ATM1 streams frames without a prompt, so don't wait for one
+	link->send("ATM1\r");
+	return true;
+}
+
+// Stops monitoring; any character interrupts the stream, ATM0/ATH0 restore polling mode.
+void COBD::stopMonitor()
+{
+	if (!link || !m_monitorCount) return;
+	char buf[128];
+	link->sendCommand("\r", buf, sizeof(buf), OBD_TIMEOUT_SHORT);
+	link->sendCommand("ATM0\r", buf, sizeof(buf), OBD_TIMEOUT_SHORT);
+	setHeaders(false);
+	m_monitorIds = 0;
+	m_monitorCount = 0;
+	// put back the response filter of the last request, so polling goes on without re-sending it
+	if (m_pollMask != OBD_HEADER_UNKNOWN && m_pollFilter != OBD_HEADER_UNKNOWN) {
+		setHeaderMask(m_pollMask);
+		setHeaderFilter(m_pollFilter);
+	}
+}
+
+// Reads one monitor line ("7E8 03 41 0D 00", "18DAF110 ...", "18 DA F1 10 ..." or "$7E8,03,41,...")
+// and keeps its CAN ID.
+int COBD::receiveFrame(uint32_t& id, byte* data, int maxLen, unsigned int timeout, uint32_t* stamp)
+{
+	if (!link) return 0;
+	char line[64];
+	uint32_t t = millis();
+	for (;;) {
+		int n = 0;
+		for (;;) {
+			int c = link->read();
+			if (c == -1) {
+				if (millis() - t >= timeout) return 0;
+				// let lower priority tasks on this core run while the bus is quiet
+				delay(1);
+				continue;
+			}
+			// a frame is stamped when its first character arrives
+			if (n == 0 && stamp) *stamp = millis();
+			if (c == '\r' || c == '\n') break;
+			if (n < (int)sizeof(line) - 1) line[n++] = c;
+		}
+		line[n] = 0;
+		const char* p = line + (line[0] == '$');
+		int idLen = decodeCanHeader(p, line + n, &id);
+		if (idLen) {
+			int bytes = decodeHexBytes(p + idLen, line + n, data, maxLen, &p);
+			bool wanted = !m_monitorCount;
+			for (byte i = 0; i < m_monitorCount && !wanted; i++) wanted = (m_monitorIds[i] == id);
+			if (wanted && bytes) return bytes;
+		}
+		// not a frame we asked for, keep reading within the timeout
+		if (millis() - t >= timeout) return 0;
+	}
+}
+
+// Checks whether a 29-bit ID needs its priority bits (ATCP) set before ATSH.
+bool COBD::needsPriority(uint32_t id)
+{
+	return id > 0x7FF && (m_canId == OBD_HEADER_UNKNOWN || m_canId <= 0x7FF || (m_canId >> 24) != (id >> 24));
+}
+
+// Formats the ATCP (priority bits of a 29-bit ID) or ATSH command addressing id.
+void COBD::formatHeaderCommand(char* buf, bool priority, uint32_t id)
+{
+	if (priority)
+		sprintf(buf, "ATCP %02X\r", (unsigned int)(id >> 24) & 0x1F);
+	else
+		sprintf(buf, id > 0x7FF ? "ATSH %06X\r" : "ATSH %03X\r", (unsigned int)id & 0xFFFFFF);
+}
+
+// Sets the 11-bit or 29-bit CAN ID for transmitting upcoming frames (skipped when unchanged).
+void COBD::setCANID(uint32_t id)
+{
+	if (link && id != m_canId) {
 		char buf[32];
-		sprintf(buf, "ATSH %X\r", id);
-		link->sendCommand(buf, buf, sizeof(buf), 1000);
+		bool ok = true;
+		if (needsPriority(id)) {
+			formatHeaderCommand(buf, true, id);
+			ok = sendHeaderCommand(buf);
+		}
+		formatHeaderCommand(buf, false, id);
+		m_canId = ok && sendHeaderCommand(buf) ? id : OBD_HEADER_UNKNOWN;
 	}
 }
 
@@ -645,5 +1169,199 @@ int COBD::sendCANMessage(byte msg[], int len, char* buf, int bufsize, unsigned i
 	}
 	cmd[len * 2] = '\r';
 	cmd[len * 2 + 1] = 0;
+	flushStale();
 	return link->sendCommand(cmd, buf, bufsize, timeout);
 }
+
+/*************************************************************************
+* Non-blocking requests
+*************************************************************************/
+
+// Claims a free request slot; -1 when every slot is queued, in flight or not yet released.
+int COBD::allocAsync(byte type, unsigned int timeout, OBD_ASYNC_CALLBACK callback, void* ctx)
+{
+	for (byte i = 0; i < OBD_ASYNC_SLOTS; i++) {
+		OBD_ASYNC& r = m_async[i];
+		if (r.status != OBD_ASYNC_FREE) continue;
+		r.type = type;
+		r.count = 0;
+		r.error = 0;
+		r.replyLen = 0;
+		r.reply[0] = 0;
+		r.timeout = timeout;
+		r.callback = callback;
+		r.ctx = ctx;
+		r.seq = m_asyncSeq++;
+		return i;
+	}
+	return -1;
+}
+
+// Queues a mode 01 request for several PIDs.
+int COBD::submitPID(const byte pid[], byte count, OBD_ASYNC_CALLBACK callback, void* ctx)
+{
+	if (!link || count == 0 || count > OBD_MAX_PIDS_PER_REQUEST) return -1;
+	int h = allocAsync(OBD_ASYNC_PID, getTimeout(requestCANID(), dataMode, OBD_TIMEOUT_SHORT), callback, ctx);
+	if (h < 0) return -1;
+	OBD_ASYNC& r = m_async[h];
+	int len = sprintf(r.cmd, "%02X", dataMode);
+	for (byte n = 0; n < count; n++) {
+		r.pid[n] = pid[n];
+		len += sprintf(r.cmd + len, "%02X", pid[n]);
+	}
+	strcpy(r.cmd + len, "\r");
+	r.count = count;
+	r.status = OBD_ASYNC_QUEUED;
+	return h;
+}
+
+// Queues a raw CAN message for canId.
+int COBD::submitCAN(uint32_t canId, const byte msg[], int len, unsigned int timeout, OBD_ASYNC_CALLBACK callback, void* ctx)
+{
+	if (!link || len <= 0 || len * 2 + 1 >= OBD_ASYNC_CMD_SIZE) return -1;
+	int h = allocAsync(OBD_ASYNC_CAN, timeout, callback, ctx);
+	if (h < 0) return -1;
+	OBD_ASYNC& r = m_async[h];
+	for (int n = 0; n < len; n++) {
+		sprintf(r.cmd + n * 2, "%02X", msg[n]);
+	}
+	strcpy(r.cmd + len * 2, "\r");
+	r.canId = canId;
+	r.status = OBD_ASYNC_QUEUED;
+	return h;
+}
+
+// Queues an AT or hex command whose reply text is kept.
+int COBD::submitCommand(const char* cmd, unsigned int timeout, OBD_ASYNC_CALLBACK callback, void* ctx)
+{
+	if (!link || strlen(cmd) >= OBD_ASYNC_CMD_SIZE) return -1;
+	int h = allocAsync(OBD_ASYNC_COMMAND, timeout, callback, ctx);
+	if (h < 0) return -1;
+	strcpy(m_async[h].cmd, cmd);
+	m_async[h].status = OBD_ASYNC_QUEUED;
+	return h;
+}
+
+// Sends the oldest queued request, switching the adapter header first when a CAN request needs it.
+bool COBD::startAsync()
+{
+	int next = -1;
+	for (byte i = 0; i < OBD_ASYNC_SLOTS; i++) {
+		if (m_async[i].status == OBD_ASYNC_QUEUED && (next < 0 || (int16_t)(m_async[i].seq - m_async[next].seq) < 0)) next = i;
+	}
+	if (next < 0) return false;
+	OBD_ASYNC& r = m_async[next];
+	char header[16];
+	m_asyncActive = next;
+	m_asyncHeader = 0;
+	if (r.type == OBD_ASYNC_CAN && r.canId != m_canId) {
+		m_asyncHeader = needsPriority(r.canId) ? 'P' : 'H';
+		formatHeaderCommand(header, m_asyncHeader == 'P', r.canId);
+	}
+	flushStale();
+	m_asyncRx.reset();
+	r.status = OBD_ASYNC_SENT;
+	r.sentAt = millis();
+	link->send(m_asyncHeader ? header : r.cmd);
+	return true;
+}
+
+// Collects received bytes without waiting, completes the request in flight and starts the next one.
+byte COBD::poll()
+{
+	byte completed = 0;
+	while (link && (m_asyncActive >= 0 || startAsync())) {
+		OBD_ASYNC& r = m_async[m_asyncActive];
+		bool prompt = false;
+		int c;
+		while (!prompt && (c = link->read()) >= 0) {
+			if (m_asyncRx.feed(c)) {
+				prompt = true;
+			} else if (m_asyncRx.searching()) {
+				// discard "SEARCHING..." and allow for the protocol search
+				r.replyLen = 0;
+				r.timeout += OBD_TIMEOUT_LONG;
+			} else if (r.replyLen < OBD_ASYNC_REPLY_SIZE - 1) {
+				r.reply[r.replyLen++] = c;
+			}
+		}
+		r.reply[r.replyLen] = 0;
+		if (!prompt) {
+			if (millis() - r.sentAt < r.timeout) break;
+			// a late reply must not be taken for the next request
+			m_stale = true;
+		} else if (m_asyncHeader && strstr(r.reply, "OK")) {
+			// header step acknowledged: ATCP is followed by ATSH, ATSH by the payload
+			char header[16];
+			if (m_asyncHeader == 'P') {
+				m_asyncHeader = 'H';
+				formatHeaderCommand(header, false, r.canId);
+			} else {
+				m_canId = r.canId;
+				m_asyncHeader = 0;
+			}
+			m_asyncRx.reset();
+			r.replyLen = 0;
+			r.sentAt = millis();
+			link->send(m_asyncHeader ? header : r.cmd);
+			continue;
+		}
+		finishAsync(r, prompt);
+		completed++;
+	}
+	return completed;
+}
+
+// Decodes a finished request, records its latency and hands it to the callback or back to the caller.
+void COBD::finishAsync(OBD_ASYNC& r, bool replied)
+{
+	bool ok = replied && !m_asyncHeader && !m_asyncRx.error();
+	if (m_asyncHeader) m_canId = OBD_HEADER_UNKNOWN;
+	r.elapsed = millis() - r.sentAt;
+	r.error = m_asyncRx.error();
+	m_asyncHeader = 0;
+	m_asyncActive = -1;
+	if (r.type == OBD_ASYNC_PID) {
+		for (byte n = 0; n < r.count; n++) r.success[n] = false;
+		byte results = ok ? parsePIDReply(r.reply, r.replyLen, r.pid, r.count, r.result, r.success) : 0;
+		recordLatency(requestCANID(), dataMode, r.elapsed, results != 0);
+		if (results) {
+			errors = 0;
+		} else {
+			errors++;
+		}
+		ok = results != 0;
+	} else if (r.type == OBD_ASYNC_CAN) {
+		recordLatency(r.canId, hex2uint8(r.cmd), r.elapsed, ok);
+	}
+	r.status = ok ? OBD_ASYNC_DONE : OBD_ASYNC_FAILED;
+	if (r.callback) {
+		r.callback(&r, r.ctx);
+		r.status = OBD_ASYNC_FREE;
+	}
+}
+
+// Returns the request behind a handle, or 0 if the slot is free.
+const OBD_ASYNC* COBD::getAsync(int handle) const
+{
+	if (handle < 0 || handle >= OBD_ASYNC_SLOTS || m_async[handle].status == OBD_ASYNC_FREE) return 0;
+	return &m_async[handle];
+}
+
+// Frees a finished or still queued request; one in flight is kept until it completes.
+bool COBD::release(int handle)
+{
+	if (handle < 0 || handle >= OBD_ASYNC_SLOTS || m_async[handle].status == OBD_ASYNC_SENT) return false;
+	m_async[handle].status = OBD_ASYNC_FREE;
+	return true;
+}
+
+// Counts requests queued or in flight.
+byte COBD::pending() const
+{
+	byte n = 0;
+	for (byte i = 0; i < OBD_ASYNC_SLOTS; i++) {
+		if (m_async[i].status == OBD_ASYNC_QUEUED || m_async[i].status == OBD_ASYNC_SENT) n++;
+	}
+	return n;
+}
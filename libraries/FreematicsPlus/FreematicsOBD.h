@@ -9,9 +9,78 @@
 #define FREEMATICS_OBD
 
 #include "utility/OBD.h"
+#include "FreematicsHex.h"
 
 #define OBD_TIMEOUT_SHORT 1000 /* ms */
 #define OBD_TIMEOUT_LONG 10000 /* ms */
+#define OBD_MAX_PIDS_PER_REQUEST 6 /* mode 01 PIDs packed into one request */
+#define OBD_MAX_PID_DATA_BYTES 11 /* longest mode 01 PID payload */
+#define OBD_HEADER_UNKNOWN 0xFFFFFFFF /* adapter header/filter state not known */
+#define OBD_LATENCY_SLOTS 8 /* CAN ID/service pairs with learned timeouts */
+#define OBD_LATENCY_BINS 12 /* response latency histogram buckets */
+#define OBD_LATENCY_MIN_SAMPLES 8 /* responses needed before a timeout is learned */
+#define OBD_LATENCY_MARGIN 50 /* ms added to the scaled 95th percentile */
+#define OBD_LATENCY_MISSES 3 /* consecutive misses before using the fallback timeout again */
+#define OBD_TIMEOUT_MIN 150 /* ms, lower bound for learned timeouts */
+#define OBD_WARM_MAGIC 0x4F424457 /* marks a valid OBD_WARM_STATE */
+#define OBD_ASYNC_SLOTS 4 /* requests queued or held by the non-blocking API */
+#define OBD_ASYNC_CMD_SIZE 48 /* command text of one request */
+#define OBD_ASYNC_REPLY_SIZE 192 /* reply text kept per request */
+
+/**
+ * @brief Response latency statistics of one CAN ID/service pair.
+ */
+typedef struct {
+	uint32_t canId; /**< request CAN ID */
+	byte service; /**< OBD/UDS service ID */
+	byte misses; /**< consecutive requests without a response */
+	uint16_t timeout; /**< learned timeout in ms, 0 until enough samples */
+	uint16_t samples; /**< responses in the histogram (aged by halving) */
+	uint16_t bins[OBD_LATENCY_BINS]; /**< response counts per latency bucket */
+} OBD_LATENCY;
+
+/**
+ * @brief Adapter state kept across ESP restarts (e.g. in RTC memory) for the warm-start path of COBD::init().
+ */
+typedef struct {
+	uint32_t magic; /**< OBD_WARM_MAGIC when valid */
+	byte protocol; /**< protocol set by the last full init */
+	int8_t flowControl; /**< ATCFC state acknowledged by the last full init */
+	char adapter[24]; /**< first line of the ATI reply */
+	char vin[18]; /**< vehicle the state belongs to, empty until known */
+} OBD_WARM_STATE;
+
+struct OBD_ASYNC;
+
+/**
+ * @brief Completion callback of a submitted request, called from COBD::poll().
+ *
+ * The request is released as soon as the callback returns.
+ */
+typedef void (*OBD_ASYNC_CALLBACK)(const struct OBD_ASYNC* req, void* ctx);
+
+/**
+ * @brief One request of the non-blocking COBD API, see COBD::submitPID().
+ */
+typedef struct OBD_ASYNC {
+	byte type; /**< OBD_ASYNC_TYPE */
+	byte status; /**< OBD_ASYNC_STATUS */
+	byte count; /**< PIDs in pid[] (OBD_ASYNC_PID) */
+	byte error; /**< adapter error token in the reply, see CLinkParser::error() */
+	uint32_t canId; /**< request CAN ID, 11 or 29 bits (OBD_ASYNC_CAN) */
+	uint16_t seq; /**< submission order */
+	uint16_t replyLen; /**< characters in reply */
+	uint32_t timeout; /**< reply timeout in ms, extended while the adapter searches */
+	uint32_t sentAt; /**< millis() when the command went out */
+	uint32_t elapsed; /**< ms from command to prompt */
+	byte pid[OBD_MAX_PIDS_PER_REQUEST]; /**< requested PIDs (OBD_ASYNC_PID) */
+	bool success[OBD_MAX_PIDS_PER_REQUEST]; /**< per-PID read status (OBD_ASYNC_PID) */
+	int result[OBD_MAX_PIDS_PER_REQUEST]; /**< normalized PID values (OBD_ASYNC_PID) */
+	char cmd[OBD_ASYNC_CMD_SIZE]; /**< command text including the trailing carriage return */
+	char reply[OBD_ASYNC_REPLY_SIZE]; /**< reply text without prompt, NUL-terminated */
+	OBD_ASYNC_CALLBACK callback; /**< completion callback, or 0 to poll with getAsync() */
+	void* ctx; /**< passed to callback */
+} OBD_ASYNC;
 
 /**
  * @brief Removes the first response line from the buffer.
@@ -23,18 +92,71 @@
  * @return Number of characters removed from the beginning of @p buffer.
  */
 int dumpLine(char* buffer, int len);
+
 /**
- * @brief Converts up to four hexadecimal characters into a 16-bit unsigned integer.
- * @param p Pointer to a character sequence that starts with hexadecimal data.
- * @return Parsed 16-bit value.
+ * @brief Incremental scanner for adapter replies.
+ *
+ * Bytes are fed one at a time as they arrive so that the "\r>" prompt,
+ * "SEARCHING..." progress text and adapter error tokens are detected
+ * without rescanning what has already been received.
  */
-uint16_t hex2uint16(const char *p);
+class CLinkParser
+{
+public:
+	/**
+	 * @brief Clears all match state before a new reply.
+	 */
+	void reset();
+	/**
+	 * @brief Scans one received byte.
+	 * @param c Received character.
+	 * @return true when @p c completes the "\r>" prompt.
+	 */
+	bool feed(char c);
+	/**
+	 * @brief Reports whether "..." (as in "SEARCHING...") was seen since the last call.
+	 * @return true once per detected ellipsis.
+	 */
+	bool searching();
+	/**
+	 * @brief Returns the first adapter error token detected in the reply.
+	 * @return 0 when none; otherwise 1-based index (UNABLE, ERROR, TIMEOUT, NO DATA, STOPPED, BUFFER FULL, ?).
+	 */
+	byte error() const { return m_error; }
+private:
+	uint64_t m_state = 0;
+	byte m_dots = 0;
+	byte m_error = 0;
+	bool m_searching = false;
+	char m_last = 0;
+};
+
 /**
- * @brief Converts one or two hexadecimal characters into an 8-bit unsigned integer.
- * @param p Pointer to a character sequence that starts with hexadecimal data.
- * @return Parsed 8-bit value, or 0 for invalid input.
+ * @brief Zero-copy iterator over the lines of an adapter reply.
+ *
+ * Lines are returned as pointer/length pairs into the original buffer;
+ * empty lines produced by "\r\n" pairs are skipped.
  */
-byte hex2uint8(const char *p);
+class CLineIterator
+{
+public:
+	/**
+	 * @brief Binds the iterator to a received buffer.
+	 * @param buffer Reply text (not modified).
+	 * @param len Number of valid characters in @p buffer.
+	 */
+	CLineIterator(const char* buffer, int len) : m_pos(buffer), m_end(buffer + len) {}
+	/**
+	 * @brief Advances to the next non-empty line.
+	 * @param line Output pointer to the first character of the line.
+	 * @param len Output line length without line terminators.
+	 * @return true if a line was returned; false at end of buffer.
+	 */
+	bool next(const char*& line, int& len);
+private:
+	const char* m_pos;
+	const char* m_end;
+};
 
 /**
  * @brief OBD-II high-level interface for Freematics serial adapters.
@@ -69,6 +191,17 @@ public:
 	 * @brief Gracefully closes the OBD session.
 	 */
 	void uninit();
+	/**
+	 * @brief Runs one step of link recovery.
+	 *
+	 * Cheaper steps keep the adapter configuration, so callers should start
+	 * with OBD_RECOVER_RESYNC and escalate while errors persist.
+	 *
+	 * @param level Recovery step to run.
+	 * @param protocol Protocol to reopen or initialize.
+	 * @return true if the adapter answered after the step; errors is cleared then.
+	 */
+	bool recover(OBD_RECOVERY level, OBD_PROTOCOLS protocol);
 	/**
 	 * @brief Sets serial baud rate for the underlying link.
 	 * @param baudrate Requested line speed in bits per second.
@@ -88,13 +221,14 @@ public:
 	 */
 	bool readPID(byte pid, int& result);
 	/**
-	 * @brief Reads several PIDs in sequence.
+	 * @brief Reads several PIDs, packing up to OBD_MAX_PIDS_PER_REQUEST of them into each request.
 	 * @param pid Array of PID identifiers to query.
 	 * @param count Number of elements in @p pid and @p result.
 	 * @param result Output array receiving normalized values per PID.
+	 * @param success Optional output array receiving per-PID read status.
 	 * @return Number of PIDs successfully read.
 	 */
-	byte readPID(const byte pid[], byte count, int result[]);
+	byte readPID(const byte pid[], byte count, int result[], bool success[] = 0);
 	/**
 	 * @brief Requests adapter low-power mode.
 	 */
@@ -129,9 +263,23 @@ public:
 	/**
 	 * @brief Checks whether a PID is marked as supported in the local PID map.
 	 * @param pid PID number to test.
-	 * @return true if supported; otherwise false.
+	 * @return true if supported or no map is known yet; otherwise false.
 	 */
 	bool isValidPID(byte pid);
+	/**
+	 * @brief Discovers the supported mode 01 PIDs (PIDs 00, 20, ... E0) into pidmap.
+	 *
+	 * Replies from several ECUs are merged. Until a map is loaded or set,
+	 * isValidPID() accepts every PID.
+	 *
+	 * @return true if at least one ECU reported its supported PIDs.
+	 */
+	bool loadPIDMap();
+	/**
+	 * @brief Sets pidmap from a previously discovered map (e.g. cached per vehicle).
+	 * @param map Supported PID bitmap, sizeof(pidmap) bytes.
+	 */
+	void setPIDMap(const byte* map);
 	/**
 	 * @brief Sets custom CAN transmit header and priority.
 	 * @param num Header value used by ATSH/ATCP adapter commands.
@@ -159,11 +307,54 @@ public:
 	 * @return Number of decoded payload bytes.
 	 */
 	int receiveData(byte* buf, int len);
+	/**
+	 * @brief Enters monitor mode for a set of broadcast CAN IDs.
+	 *
+	 * The adapter filter/mask is set to the narrowest pair that passes all
+	 * IDs (the bits they share); receiveFrame() drops anything else.
+	 * Headers are turned on so every frame carries its CAN ID.
+	 *
+	 * @param ids Array of CAN IDs to capture, either all 11-bit or all 29-bit.
+	 * @param count Number of elements in @p ids.
+	 * @return true if monitoring was started.
+	 */
+	bool startMonitor(const uint32_t ids[], byte count);
+	/**
+	 * @brief Leaves monitor mode and restores headers-off request/response operation.
+	 *
+	 * The response filter/mask in effect before startMonitor() is programmed
+	 * again, so the next request to the same ECUs needs no header commands.
+	 */
+	void stopMonitor();
+	/**
+	 * @brief Receives one monitored frame together with its CAN ID.
+	 * @param id Output CAN identifier of the frame.
+	 * @param data Output buffer for frame data bytes.
+	 * @param maxLen Capacity of @p data.
+	 * @param timeout Maximum time to wait for a complete line in milliseconds.
+	 * @param stamp Optional output of millis() when the frame started to arrive.
+	 * @return Number of data bytes, or 0 if no frame was received.
+	 */
+	int receiveFrame(uint32_t& id, byte* data, int maxLen, unsigned int timeout, uint32_t* stamp = 0);
 	/**
 	 * @brief Sets CAN identifier for outgoing frames.
-	 * @param id 11-bit or 29-bit CAN identifier, depending on adapter mode.
+	 *
+	 * IDs above 0x7FF are sent as 29-bit headers: the top five bits via
+	 * ATCP, the rest via ATSH. They need a 29-bit CAN protocol.
+	 *
+	 * @param id 11-bit or 29-bit CAN identifier.
+	 */
+	void setCANID(uint32_t id);
+	/**
+	 * @brief Shows or hides the CAN ID of every reply frame (ATH1/ATH0).
+	 *
+	 * With headers on, multi-frame replies arrive as raw frames with their
+	 * PCI bytes, so replies of several ECUs can be told apart.
+	 *
+	 * @param enabled true to show headers.
+	 * @return true if the setting is in effect (cached or acknowledged).
 	 */
-	void setCANID(uint16_t id);
+	bool setHeaders(bool enabled = true);
 	/**
 	 * @brief Sends one CAN message encoded as hexadecimal characters.
 	 * @param msg Input byte array with payload to transmit.
@@ -174,11 +365,125 @@ public:
 	 * @return Number of characters received in adapter response, or 0 on failure.
 	 */
 	int sendCANMessage(byte msg[], int len, char* buf, int bufsize, unsigned int timeout = 100);
+	/**
+	 * @brief Enables or disables adapter ISO-TP flow control (ATCFC).
+	 * @param enabled true to let the adapter send flow control frames.
+	 * @return true if the setting is in effect (cached or acknowledged).
+	 */
+	bool setFlowControl(bool enabled = true);
+	/**
+	 * @brief Forgets the cached header, mask, filter and flow control state.
+	 *
+	 * Call after anything that may reset the adapter behind COBD's back.
+	 */
+	void invalidateHeaderState();
+	/**
+	 * @brief Attaches caller-owned storage for the warm-start cache.
+	 *
+	 * While the cache is valid, init() only probes the adapter with ATI. The
+	 * full sequence runs only if the adapter was reset (echo back on) or its
+	 * identity changed.
+	 *
+	 * @param state Storage that survives restarts (e.g. RTC_DATA_ATTR), or 0 to disable.
+	 */
+	void setWarmState(OBD_WARM_STATE* state) { m_warm = state; }
+	/**
+	 * @brief Forces the next init() through the full sequence.
+	 */
+	void invalidateWarmState() { if (m_warm) m_warm->magic = 0; }
+	/**
+	 * @brief Keys the warm-start cache to a vehicle.
+	 * @param vin VIN read after init().
+	 * @return false if the last init() was a warm start negotiated with another vehicle; the cache is dropped and a full init() is due.
+	 */
+	bool checkWarmVIN(const char* vin);
+	/**
+	 * @brief Returns the timeout to use for a request, learned from past response latency.
+	 * @param canId Request CAN ID.
+	 * @param service OBD/UDS service ID of the request.
+	 * @param fallback Timeout used until enough responses were seen or after repeated misses.
+	 * @return Timeout in milliseconds.
+	 */
+	unsigned int getTimeout(uint32_t canId, byte service, unsigned int fallback);
+	/**
+	 * @brief Records the outcome of a request for timeout learning.
+	 * @param canId Request CAN ID.
+	 * @param service OBD/UDS service ID of the request.
+	 * @param elapsed Time from request to response in milliseconds.
+	 * @param responded true if the ECU answered; false on timeout or NO DATA.
+	 */
+	void recordLatency(uint32_t canId, byte service, unsigned int elapsed, bool responded);
+	/**
+	 * @brief Provides access to the latency statistics for diagnostics.
+	 * @param count Output number of valid entries.
+	 * @return Pointer to the statistics table.
+	 */
+	const OBD_LATENCY* getLatencyStats(byte& count) const { count = m_latencyCount; return m_latency; }
+	/**
+	 * @brief Queues a mode 01 request for up to OBD_MAX_PIDS_PER_REQUEST PIDs without waiting for the reply.
+	 *
+	 * Submitted requests go out one per adapter prompt, back to back, as
+	 * poll() is called. The blocking calls must not be used while
+	 * requests are pending().
+	 *
+	 * @param pid Array of PID identifiers.
+	 * @param count Number of elements in @p pid.
+	 * @param callback Completion callback, or 0 to check with getAsync().
+	 * @param ctx Passed to @p callback.
+	 * @return Request handle, or -1 if no slot is free.
+	 */
+	int submitPID(const byte pid[], byte count, OBD_ASYNC_CALLBACK callback = 0, void* ctx = 0);
+	/**
+	 * @brief Queues a raw CAN message; the adapter header is switched to @p canId first if needed.
+	 * @param canId Request CAN ID, 11 or 29 bits.
+	 * @param msg Payload bytes.
+	 * @param len Number of bytes in @p msg.
+	 * @param timeout Reply timeout in milliseconds.
+	 * @param callback Completion callback, or 0 to check with getAsync().
+	 * @param ctx Passed to @p callback.
+	 * @return Request handle, or -1 if no slot is free or the payload does not fit.
+	 */
+	int submitCAN(uint32_t canId, const byte msg[], int len, unsigned int timeout = 100, OBD_ASYNC_CALLBACK callback = 0, void* ctx = 0);
+	/**
+	 * @brief Queues an AT or hex command whose reply text is kept.
+	 * @param cmd Command text including the trailing carriage return.
+	 * @param timeout Reply timeout in milliseconds.
+	 * @param callback Completion callback, or 0 to check with getAsync().
+	 * @param ctx Passed to @p callback.
+	 * @return Request handle, or -1 if no slot is free or the command does not fit.
+	 */
+	int submitCommand(const char* cmd, unsigned int timeout, OBD_ASYNC_CALLBACK callback = 0, void* ctx = 0);
+	/**
+	 * @brief Advances the request queue without waiting.
+	 *
+	 * Collects the reply bytes already received, completes the request in
+	 * flight on its prompt or timeout and sends the next queued one.
+	 * Callbacks run from here and must not call poll() themselves.
+	 *
+	 * @return Number of requests completed by this call.
+	 */
+	byte poll();
+	/**
+	 * @brief Returns a submitted request for inspection.
+	 * @param handle Handle returned by one of the submit calls.
+	 * @return The request, or 0 if @p handle is not in use.
+	 */
+	const OBD_ASYNC* getAsync(int handle) const;
+	/**
+	 * @brief Frees a request slot once its result was read, or cancels a request that was not sent yet.
+	 * @param handle Handle returned by one of the submit calls.
+	 * @return false if the request is in flight and cannot be released yet.
+	 */
+	bool release(int handle);
+	/**
+	 * @brief Number of requests queued or in flight.
+	 */
+	byte pending() const;
 	// set current PID mode
 	byte dataMode = 1;
 	// occurrence of errors
 	byte errors = 0;
-	// bit map of supported PIDs
+	// bit map of supported PIDs, valid once m_pidmapValid is set
 	byte pidmap[4 * 8] = {0};
 	// link object pointer
 	CLink* link = 0;
@@ -195,6 +500,43 @@ protected:
 	 * @return Pointer to parsed data field inside @p buffer, or nullptr on failure.
 	 */
 	char* getResponse(byte& pid, char* buffer, byte bufsize);
+	/**
+	 * @brief Sends one multi-PID request and parses the (possibly multi-frame) reply in one pass.
+	 * @param pid Array of up to OBD_MAX_PIDS_PER_REQUEST PID identifiers.
+	 * @param count Number of elements in @p pid.
+	 * @param result Output array receiving normalized values per PID.
+	 * @param success Output array receiving per-PID read status.
+	 * @return Number of PIDs successfully read.
+	 */
+	byte readPIDBatch(const byte pid[], byte count, int result[], bool success[]);
+	/**
+	 * @brief Walks one decoded mode 01 response message and normalizes every requested PID in it.
+	 * @param msg Decoded response bytes starting with the response mode byte.
+	 * @param len Number of bytes in @p msg.
+	 * @param pid Array of requested PID identifiers.
+	 * @param count Number of elements in @p pid.
+	 * @param result Output array receiving normalized values per PID.
+	 * @param success Output array receiving per-PID read status.
+	 * @return Number of PIDs newly decoded from @p msg.
+	 */
+	byte parsePIDMessage(const byte* msg, int len, const byte pid[], byte count, int result[], bool success[]);
+	/**
+	 * @brief Decodes a complete mode 01 reply (single or multi-frame, one or more ECUs).
+	 * @param buffer Reply text.
+	 * @param len Number of characters in @p buffer.
+	 * @param pid Array of requested PID identifiers.
+	 * @param count Number of elements in @p pid.
+	 * @param result Output array receiving normalized values per PID.
+	 * @param success Output array receiving per-PID read status.
+	 * @return Number of PIDs decoded.
+	 */
+	byte parsePIDReply(const char* buffer, int len, const byte pid[], byte count, int result[], bool success[]);
+	/**
+	 * @brief Returns payload length of a mode 01 PID as defined by SAE J1979.
+	 * @param pid PID identifier.
+	 * @return Number of data bytes, or 0 when unknown.
+	 */
+	byte getPIDDataLength(byte pid);
 	/**
 	 * @brief Converts one-byte PID payload into 0..100% scale.
 	 * @param data Pointer to ASCII hexadecimal payload.
@@ -238,7 +580,80 @@ protected:
 	 * @return Pointer to first numeric token within @p buf, or nullptr if none.
 	 */
 	char* getResultValue(char* buf);
+	/**
+	 * @brief Sends one header related AT command and checks for OK.
+	 * @param cmd Command text including the trailing carriage return.
+	 * @return true if the adapter acknowledged the command.
+	 */
+	bool sendHeaderCommand(const char* cmd);
+	/**
+	 * @brief Discards a late reply left over from a request that timed out.
+	 */
+	void flushStale();
+	/**
+	 * @brief Returns the CAN ID functional OBD requests currently go to.
+	 * @return Cached header, or 0x7DF when unknown.
+	 */
+	uint32_t requestCANID() { return m_canId != OBD_HEADER_UNKNOWN ? m_canId : 0x7DF; }
+	/**
+	 * @brief Probes the adapter against the warm-start cache.
+	 * @return true if the cached state is still in effect and the full init can be skipped.
+	 */
+	bool warmStart(OBD_PROTOCOLS protocol);
+	/**
+	 * @brief Records the state negotiated by a full init in the warm-start cache.
+	 */
+	void saveWarmState(OBD_PROTOCOLS protocol, const char* adapter);
+	/**
+	 * @brief Checks whether a 29-bit ID needs ATCP because its priority bits differ from the cached header.
+	 */
+	bool needsPriority(uint32_t id);
+	/**
+	 * @brief Formats the ATCP (priority bits) or ATSH command addressing @p id.
+	 */
+	void formatHeaderCommand(char* buf, bool priority, uint32_t id);
+	/**
+	 * @brief Claims a free request slot.
+	 * @return Slot index, or -1 if all slots are in use.
+	 */
+	int allocAsync(byte type, unsigned int timeout, OBD_ASYNC_CALLBACK callback, void* ctx);
+	/**
+	 * @brief Sends the oldest queued request, preceded by ATSH when it targets another CAN ID.
+	 * @return false if nothing is queued.
+	 */
+	bool startAsync();
+	/**
+	 * @brief Decodes a finished request and hands it to its callback or back to the caller.
+	 */
+	void finishAsync(OBD_ASYNC& r, bool replied);
+	// CAN IDs passed to startMonitor(), filtered in software
+	const uint32_t* m_monitorIds = 0;
+	byte m_monitorCount = 0;
+	// response filter/mask replaced by startMonitor(), restored by stopMonitor()
+	uint32_t m_pollMask = OBD_HEADER_UNKNOWN;
+	uint32_t m_pollFilter = OBD_HEADER_UNKNOWN;
 	OBD_STATES m_state = OBD_DISCONNECTED;
+	// adapter state last acknowledged, so unchanged settings are not sent again
+	uint32_t m_canId = OBD_HEADER_UNKNOWN;
+	uint32_t m_headerMask = OBD_HEADER_UNKNOWN;
+	uint32_t m_headerFilter = OBD_HEADER_UNKNOWN;
+	int8_t m_flowControl = -1;
+	int8_t m_headers = -1;
+	// learned response timeouts
+	OBD_LATENCY m_latency[OBD_LATENCY_SLOTS] = {};
+	byte m_latencyCount = 0;
+	bool m_stale = false;
+	// warm-start cache, owned by the caller
+	OBD_WARM_STATE* m_warm = 0;
+	bool m_warmStarted = false;
+	bool m_pidmapValid = false;
+	// non-blocking requests; at most one is in flight on the link
+	OBD_ASYNC m_async[OBD_ASYNC_SLOTS] = {};
+	CLinkParser m_asyncRx;
+	int8_t m_asyncActive = -1;
+	// header step of the request in flight: 'P' (ATCP), 'H' (ATSH) or 0
+	char m_asyncHeader = 0;
+	uint16_t m_asyncSeq = 0;
 };
 
 #endif
@@ -178,11 +178,13 @@ int readChipHallSensor()
     return 0; // FIXME
 }
 
-bool Task::create(void (*task)(void*), const char* name, int priority, int stacksize)
+bool Task::create(void (*task)(void*), const char* name, int priority, int stacksize, int core)
 {
     if (xHandle) return false;
     /* Create the task, storing the handle. */
-    BaseType_t xReturned = xTaskCreate(task, name, stacksize, (void*)this, priority, &xHandle);
+    BaseType_t xReturned = core < 0 ?
+        xTaskCreate(task, name, stacksize, (void*)this, priority, &xHandle) :
+        xTaskCreatePinnedToCore(task, name, stacksize, (void*)this, priority, &xHandle, core);
     return xReturned == pdPASS;
 }
 
@@ -251,6 +253,7 @@ bool CLink_UART::begin(unsigned int baudrate, int rxPin, int txPin)
     //Install UART driver
     if (uart_driver_install(LINK_UART_NUM, LINK_UART_BUF_SIZE, 0, 0, NULL, 0) != ESP_OK)
 		return false;
+	m_baudrate = baudrate;
 	return true;
 }
 
@@ -267,6 +270,8 @@ int CLink_UART::receive(char* buffer, int bufsize, unsigned int timeout)
 	int n = 0;
 	unsigned long startTime = millis();
 	unsigned long elapsed;
+	m_rx.reset();
+	buffer[0] = 0;
 	for (;;) {
 		elapsed = millis() - startTime;
 		if (elapsed > timeout) break;
@@ -274,18 +279,27 @@ int CLink_UART::receive(char* buffer, int bufsize, unsigned int timeout)
 		int len = uart_read_bytes(LINK_UART_NUM, (uint8_t*)buffer + n, bufsize - n - 1, 1);
 		if (len < 0) break;
 		if (len == 0) continue;
-		buffer[n + len] = 0;
-		if (strstr(buffer + n, "\r>")) {
-			n = n + len - 1;
-			buffer[n] = 0;
-			break;
-		}
-		n += len;
-		if (strstr(buffer, "...")) {
-			buffer[0] = 0;
-			n = 0;
-			timeout += OBD_TIMEOUT_LONG;
+		// scan only the newly received bytes
+		bool prompt = false;
+		int end = n + len;
+		for (int pos = n; pos < end; pos++) {
+			if (m_rx.feed(buffer[pos])) {
+				// drop the prompt character, keep the preceding line break
+				end = pos;
+				prompt = true;
+				break;
+			}
+			if (m_rx.searching()) {
+				// discard "SEARCHING..." but keep whatever followed it in this chunk
+				end -= pos + 1;
+				memmove(buffer, buffer + pos + 1, end);
+				pos = -1;
+				timeout += OBD_TIMEOUT_LONG;
+			}
 		}
+		n = end;
+		buffer[n] = 0;
+		if (prompt) break;
 	}
 #if VERBOSE_LINK
 	Serial.print("[UART RECV]");
@@ -319,14 +333,55 @@ int CLink_UART::read()
         return -1;
 }
 
+// Checks that LINK_UART_VERIFY consecutive ATI replies match the reference reply.
+bool CLink_UART::verify(const char* ref)
+{
+	char buf[32];
+	byte ok = 0;
+	for (byte n = 0; n < LINK_UART_VERIFY * 2 && ok < LINK_UART_VERIFY; n++) {
+		if (sendCommand("ATI\r", buf, sizeof(buf), 200) && !strcmp(buf, ref))
+			ok++;
+		else
+			ok = 0;
+	}
+	return ok == LINK_UART_VERIFY;
+}
+
+// Switches the co-processor and the UART to baudrate and keeps it only if ATI replies come back intact.
 bool CLink_UART::changeBaudRate(unsigned int baudrate)
 {
+	char ref[32];
 	char buf[32];
+	unsigned int prev = m_baudrate;
+	if (baudrate == prev) return true;
+	// reference reply at the working rate
+	byte n = 0;
+	while (!sendCommand("ATI\r", ref, sizeof(ref), 1000) || !strstr(ref, "OBD")) {
+		if (++n == 3) return false;
+	}
 	sprintf(buf, "ATBR1 %X\r", baudrate);
 	sendCommand(buf, buf, sizeof(buf), 1000);
+	// firmware without ATBR1 stays at the current rate
+	if (strchr(buf, '?') || strstr(buf, "ERROR")) return false;
 	delay(50);
 	end();
-	return begin(baudrate);
+	begin(baudrate);
+	if (verify(ref)) return true;
+	// ask the co-processor to go back; the command may still get through a marginal link
+	sprintf(buf, "ATBR1 %X\r", prev);
+	send(buf);
+	delay(50);
+	end();
+	begin(prev);
+	return false;
+}
+
+// READY pin falling edge: the co-processor has a reply, wake up the waiting task
+static void IRAM_ATTR linkReadyISR(void* arg)
+{
+	BaseType_t woken = pdFALSE;
+	xSemaphoreGiveFromISR((SemaphoreHandle_t)arg, &woken);
+	if (woken) portYIELD_FROM_ISR();
 }
 
 bool CLink_SPI::begin(unsigned int freq, int rxPin, int txPin)
@@ -343,6 +398,9 @@ bool CLink_SPI::begin(unsigned int freq, int rxPin, int txPin)
     }
 	SPI.begin();
 	SPI.setFrequency(freq);
+	m_freq = freq;
+	if (!m_ready) m_ready = xSemaphoreCreateBinary();
+	attachInterruptArg(PIN_LINK_SPI_READY, linkReadyISR, (void*)m_ready, FALLING);
 	esp_sleep_pd_config(ESP_PD_DOMAIN_RTC_PERIPH, ESP_PD_OPTION_ON);
 	return true;
 }
@@ -352,6 +410,7 @@ void CLink_SPI::end()
 #if VERBOSE_LINK
     Serial.println("[SPI END]");
 #endif
+	detachInterrupt(PIN_LINK_SPI_READY);
 	SPI.end();
 }
 
@@ -360,55 +419,67 @@ int CLink_SPI::receive(char* buffer, int bufsize, unsigned int timeout)
 	int n = 0;
 	bool eos = false;
 	bool matched = false;
-	portMUX_TYPE m = portMUX_INITIALIZER_UNLOCKED;
+	uint8_t tx[LINK_SPI_CHUNK];
+	uint8_t rx[LINK_SPI_CHUNK];
+	memset(tx, ' ', sizeof(tx));
 	uint32_t t = millis();
 	do {
+		// sleep until the READY interrupt fires instead of polling the pin
 		while (digitalRead(PIN_LINK_SPI_READY) == HIGH) {
-			if (millis() - t > 3000) return -1;
-            delay(1);
+			uint32_t elapsed = millis() - t;
+			if (elapsed > 3000) return -1;
+			if (m_ready) {
+				xSemaphoreTake(m_ready, pdMS_TO_TICKS(3000 - elapsed) + 1);
+			} else {
+				delay(1);
+			}
 		}
 #if VERBOSE_LINK
     	Serial.println("[SPI RECV]");
 #endif
-		portENTER_CRITICAL(&m);
+		// the transaction holds the bus against SD access without masking interrupts
+		SPI.beginTransaction(SPISettings(m_freq, SPI_MSBFIRST, SPI_MODE0));
 		digitalWrite(PIN_LINK_SPI_CS, LOW);
 		while (digitalRead(PIN_LINK_SPI_READY) == LOW && millis() - t < timeout) {
-			char c = SPI.transfer(' ');
-			if (c == 0 && c == 0xff) continue;
-			if (!eos) eos = (c == 0x9);
-			if (eos) continue;
-			if (!matched) {
-				// match header
-				if (n == 0 && c != header[0]) continue;
-				if (n == bufsize - 1) continue;
-				buffer[n++] = c;
-				if (n == sizeof(header)) {
-					matched = memcmp(buffer, header, sizeof(header)) == 0;
-					if (matched) {
-						n = 0;
-					} else {
-						memmove(buffer, buffer + 1, --n);
+			SPI.transferBytes(tx, rx, sizeof(rx));
+			for (int i = 0; i < (int)sizeof(rx); i++) {
+				char c = rx[i];
+				if (c == 0 || c == (char)0xff) continue;
+				if (!eos) eos = (c == 0x9);
+				if (eos) continue;
+				if (!matched) {
+					// match header
+					if (n == 0 && c != header[0]) continue;
+					if (n == bufsize - 1) continue;
+					buffer[n++] = c;
+					if (n == sizeof(header)) {
+						matched = memcmp(buffer, header, sizeof(header)) == 0;
+						if (matched) {
+							n = 0;
+						} else {
+							memmove(buffer, buffer + 1, --n);
+						}
 					}
+					continue;
 				}
-				continue;
-			}
-			if (n > 3 && c == '.' && buffer[n - 1] == '.' && buffer[n - 2] == '.') {
-				// SEARCHING...
-				n = 0;
-				timeout += OBD_TIMEOUT_LONG;
-			} else {
-				if (n == bufsize - 1) {
-					int bytesDumped = dumpLine(buffer, n);
-					n -= bytesDumped;
+				if (n > 3 && c == '.' && buffer[n - 1] == '.' && buffer[n - 2] == '.') {
+					// SEARCHING...
+					n = 0;
+					timeout += OBD_TIMEOUT_LONG;
+				} else {
+					if (n == bufsize - 1) {
+						int bytesDumped = dumpLine(buffer, n);
+						n -= bytesDumped;
 #if VERBOSE_LINK
-					Serial.println("[SPI BUFFER FULL]");
+						Serial.println("[SPI BUFFER FULL]");
 #endif
+					}
+					buffer[n++] = c;
 				}
-				buffer[n++] = c;
 			}
 		}
 		digitalWrite(PIN_LINK_SPI_CS, HIGH);
-		portEXIT_CRITICAL(&m);
+		SPI.endTransaction();
 	} while (!eos && millis() - t < timeout);
 #if VERBOSE_LINK
 	if (!eos) {
@@ -434,14 +505,15 @@ bool CLink_SPI::send(const char* str)
 #endif
         return false;
     }
-	portMUX_TYPE m = portMUX_INITIALIZER_UNLOCKED;
 #if VERBOSE_LINK
 	Serial.print("[SPI SEND]");
 	Serial.println(str);
 #endif
 	int len = strlen(str);
 	uint8_t tail = 0x1B;
-	portENTER_CRITICAL(&m);
+	// a pending READY edge belongs to an earlier exchange
+	if (m_ready) xSemaphoreTake(m_ready, 0);
+	SPI.beginTransaction(SPISettings(m_freq, SPI_MSBFIRST, SPI_MODE0));
 	digitalWrite(PIN_LINK_SPI_CS, LOW);
 	delay(1);
 	SPI.writeBytes((uint8_t*)header, sizeof(header));
@@ -449,7 +521,7 @@ bool CLink_SPI::send(const char* str)
 	SPI.writeBytes((uint8_t*)&tail, 1);
 	delay(1);
 	digitalWrite(PIN_LINK_SPI_CS, HIGH);
-	portEXIT_CRITICAL(&m);
+	SPI.endTransaction();
     return true;
 }
 
@@ -877,14 +949,63 @@ void FreematicsESP32::resetLink()
         delay(50);
         digitalWrite(PIN_LINK_RESET, HIGH);
         delay(1000);
+        restoreLinkBaudRate();
         return;
     }
 #endif
     char buf[16];
     if (link) link->sendCommand("ATR\r", buf, sizeof(buf), 100);
+    restoreLinkBaudRate();
+}
+
+// Brings the UART link back to the negotiated rate after a co-processor reset reverted it to the default.
+void FreematicsESP32::restoreLinkBaudRate()
+{
+    if (!(m_flags & FLAG_USE_UART_LINK)) return;
+    CLink_UART* uart = (CLink_UART*)link;
+    char buf[32];
+    for (byte n = 0; n < 2; n++) {
+        if (uart->baudRate() == m_linkBaudRate && uart->sendCommand("ATI\r", buf, sizeof(buf), 1000)) return;
+    }
+    uart->end();
+    uart->begin(LINK_UART_BAUDRATE);
+    if (m_linkBaudRate != LINK_UART_BAUDRATE && !uart->changeBaudRate(m_linkBaudRate)) {
+        m_linkBaudRate = LINK_UART_BAUDRATE;
+    }
+}
+
+// Moves the UART link to baudrate, resetting the co-processor if a failed switch left it unreachable.
+bool FreematicsESP32::setLinkBaudRate(unsigned int baudrate)
+{
+    CLink_UART* uart = (CLink_UART*)link;
+    if (uart->changeBaudRate(baudrate)) {
+        m_linkBaudRate = baudrate;
+        return true;
+    }
+    char buf[32];
+    if (!uart->sendCommand("ATI\r", buf, sizeof(buf), 1000)) {
+        m_linkBaudRate = LINK_UART_BAUDRATE;
+        resetLink();
+    }
+    return false;
+}
+
+// Tries the rates fastest first and keeps the first one the link carries reliably.
+unsigned int FreematicsESP32::negotiateLinkBaudRate(const unsigned int* rates, byte count)
+{
+    if (!(m_flags & FLAG_USE_UART_LINK)) return 0;
+    for (byte i = 0; i < count; i++) {
+        if (rates[i] == m_linkBaudRate || setLinkBaudRate(rates[i])) break;
+    }
+    return m_linkBaudRate;
+}
+
+unsigned int FreematicsESP32::linkBaudRate()
+{
+    return (m_flags & FLAG_USE_UART_LINK) ? ((CLink_UART*)link)->baudRate() : 0;
 }
 
-bool FreematicsESP32::begin(bool useCoProc, bool useCellular)
+bool FreematicsESP32::begin(bool useCoProc, bool useCellular, unsigned int linkBaudRate)
 {
     // set wifi max power
     esp_wifi_set_max_tx_power(80);
@@ -908,19 +1029,19 @@ bool FreematicsESP32::begin(bool useCoProc, bool useCellular)
         digitalWrite(PIN_LINK_RESET, HIGH);
 #endif
         CLink_UART *linkUART = new CLink_UART;
-#if 0
-        linkUART->begin(115200);
-        char buf[16];
-        // lift baudrate to 512Kbps
-        linkUART->sendCommand("ATBR1 7D000\r", buf, sizeof(buf), 50);
-        linkUART->end();
-        delay(50);
-#endif
-        if (linkUART->begin(115200)) {
+        if (linkUART->begin(LINK_UART_BAUDRATE)) {
             link = linkUART;
             for (byte n = 0; n < 3 && !getDeviceType(); n++);
+            if (!devType && linkBaudRate != LINK_UART_BAUDRATE) {
+                // the co-processor keeps the rate set before an ESP32 restart
+                linkUART->end();
+                linkUART->begin(linkBaudRate);
+                for (byte n = 0; n < 3 && !getDeviceType(); n++);
+            }
             if (devType) {
                 m_flags |= FLAG_USE_UART_LINK;
+                m_linkBaudRate = linkUART->baudRate();
+                if (linkBaudRate != m_linkBaudRate) setLinkBaudRate(linkBaudRate);
                 break;
             }
             link = 0;
@@ -18,6 +18,7 @@
 #include "FreematicsNetwork.h"
 #include "FreematicsMEMS.h"
 #include "FreematicsOBD.h"
+#include "FreematicsTrace.h"
 extern "C" {
 #include "utility/ble_spp_server.h"
 }
@@ -27,6 +28,7 @@ extern "C" {
 #define PIN_LINK_SPI_CS 2
 #define PIN_LINK_SPI_READY 13
 #define SPI_FREQ 1000000
+#define LINK_SPI_CHUNK 32 /* bytes clocked per SPI transfer while receiving */
 
 #if CONFIG_IDF_TARGET_ESP32C3 && !defined(ARDUINO_ESP32C3_DEV)
 #define ARDUINO_ESP32C3_DEV
@@ -51,8 +53,9 @@ extern "C" {
 #define PIN_BEE_UART_TXD 19
 #endif
 #define LINK_UART_BAUDRATE 115200
+#define LINK_UART_VERIFY 3 /* consecutive matching ATI replies required after a baud rate change */
 
-#define LINK_UART_BUF_SIZE 256
+#define LINK_UART_BUF_SIZE 1024
 #define PIN_LINK_UART_RX 13
 #define PIN_LINK_UART_TX 14
 
@@ -87,7 +90,8 @@ uint16_t getFlashSize(); /* KB */
 class Task
 {
 public:
-  bool create(void (*task)(void*), const char* name, int priority = 0, int stacksize = 1024);
+  // core -1 lets the scheduler pick; 0 or 1 pins the task to that core
+  bool create(void (*task)(void*), const char* name, int priority = 0, int stacksize = 1024, int core = -1);
   void destroy();
   void suspend();
   void resume();
@@ -119,8 +123,16 @@ public:
 	bool send(const char* str);
   // read one byte from UART
   int read();
-  // change serial baudrate
+  // change serial baudrate on both ends, verified by ATI round trips (returns to the previous rate on failure)
   bool changeBaudRate(unsigned int baudrate);
+  // current serial baudrate
+  unsigned int baudRate() const { return m_baudrate; }
+  // scanner state of the last received reply (prompt, error token)
+  const CLinkParser& rxState() const { return m_rx; }
+private:
+  bool verify(const char* ref);
+  CLinkParser m_rx;
+  unsigned int m_baudrate = LINK_UART_BAUDRATE;
 };
 
 class CLink_SPI : public CLink {
@@ -135,12 +147,19 @@ public:
 	bool send(const char* str);
 private:
 	const uint8_t header[4] = {0x24, 0x4f, 0x42, 0x44};
+	// given by the READY pin interrupt, taken while waiting for a reply
+	SemaphoreHandle_t m_ready = 0;
+	unsigned int m_freq = SPI_FREQ;
 };
 
 class FreematicsESP32 : public CFreematics
 {
 public:
-  bool begin(bool useCoProc = true, bool useCellular = true);
+  bool begin(bool useCoProc = true, bool useCellular = true, unsigned int linkBaudRate = LINK_UART_BAUDRATE);
+  // raise the UART link to the first rate in rates[] (fastest first) that passes verification
+  unsigned int negotiateLinkBaudRate(const unsigned int* rates, byte count);
+  // baudrate of the UART link (0 for the SPI link)
+  unsigned int linkBaudRate();
   // start GPS
   bool gpsBegin();
   // start GPS
@@ -181,7 +200,10 @@ public:
 	// co-processor link
 	CLink *link = 0;
 private:
+  bool setLinkBaudRate(unsigned int baudrate);
+  void restoreLinkBaudRate();
   byte m_flags = 0;
   byte m_pinGPSPower = 0;
+  unsigned int m_linkBaudRate = LINK_UART_BAUDRATE;
 };
 #endif
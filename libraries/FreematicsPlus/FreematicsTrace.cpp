@@ -0,0 +1,233 @@
+/*************************************************************************
+* Adapter conversation trace recording and replay for Freematics ONE+
+* Distributed under BSD license
+* Visit https://freematics.com for more information
+*************************************************************************/
+
+#include <Arduino.h>
+#include "FreematicsBase.h"
+#include "FreematicsTrace.h"
+
+// Starts recording into out, writing the trace header first.
+void CTraceLink::attach(Print* out)
+{
+	flush();
+	m_out = out;
+	m_len = 0;
+	m_size = 0;
+	m_readLen = 0;
+	m_lastTime = millis();
+	if (out) putBytes(TRACE_MAGIC, 4);
+}
+
+// Writes buffered records to the output.
+void CTraceLink::flush()
+{
+	if (m_out && m_len) m_out->write(m_buf, m_len);
+	m_len = 0;
+}
+
+// Appends bytes to the record buffer, writing it out whenever it fills up.
+void CTraceLink::putBytes(const void* data, int len)
+{
+	const byte* p = (const byte*)data;
+	m_size += len;
+	while (len > 0) {
+		int n = TRACE_BUFFER_SIZE - m_len;
+		if (n > len) n = len;
+		memcpy(m_buf + m_len, p, n);
+		m_len += n;
+		p += n;
+		len -= n;
+		if (m_len == TRACE_BUFFER_SIZE) flush();
+	}
+}
+
+// Appends a base 128 varint.
+void CTraceLink::putVarint(uint32_t value)
+{
+	byte tmp[5];
+	int n = 0;
+	do {
+		tmp[n] = value & 0x7f;
+		value >>= 7;
+		if (value) tmp[n] |= 0x80;
+		n++;
+	} while (value);
+	putBytes(tmp, n);
+}
+
+// Appends one record stamped with the time since the previous record.
+void CTraceLink::record(byte type, const void* data, int len, uint32_t ts)
+{
+	if (!m_out) return;
+	if (len < 0) len = 0;
+	putBytes(&type, 1);
+	putVarint(ts - m_lastTime);
+	putVarint(len);
+	putBytes(data, len);
+	m_lastTime = ts;
+}
+
+// Emits the pending read() bytes as one record.
+void CTraceLink::flushRead()
+{
+	if (m_readLen) {
+		record(TRACE_READ, m_read, m_readLen, m_readTime);
+		m_readLen = 0;
+	}
+}
+
+// Records and forwards a command, then records its reply.
+int CTraceLink::sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+{
+	if (!m_link) return 0;
+	flushRead();
+	record(TRACE_SEND, cmd, strlen(cmd), millis());
+	int n = m_link->sendCommand(cmd, buf, bufsize, timeout);
+	record(TRACE_RECV, buf, n, millis());
+	return n;
+}
+
+// Forwards a receive and records the reply (empty on timeout).
+int CTraceLink::receive(char* buffer, int bufsize, unsigned int timeout)
+{
+	if (!m_link) return 0;
+	flushRead();
+	int n = m_link->receive(buffer, bufsize, timeout);
+	record(TRACE_RECV, buffer, n, millis());
+	return n;
+}
+
+// Records and forwards outgoing bytes.
+bool CTraceLink::send(const char* str)
+{
+	if (!m_link) return false;
+	flushRead();
+	record(TRACE_SEND, str, strlen(str), millis());
+	return m_link->send(str);
+}
+
+// Forwards a single byte read, coalescing consecutive bytes into one record.
+int CTraceLink::read()
+{
+	if (!m_link) return -1;
+	int c = m_link->read();
+	if (c < 0) {
+		flushRead();
+		return c;
+	}
+	if (!m_readLen) m_readTime = millis();
+	m_read[m_readLen++] = c;
+	if (m_readLen == TRACE_MAX_READ) flushRead();
+	return c;
+}
+
+// Attaches a trace image and checks its header.
+bool CReplayLink::load(const byte* data, uint32_t len, bool realtime)
+{
+	m_data = data;
+	m_len = len;
+	m_realtime = realtime;
+	if (len < 4 || memcmp(data, TRACE_MAGIC, 4)) {
+		m_len = 0;
+		m_pos = 0;
+		return false;
+	}
+	rewind();
+	return true;
+}
+
+// Restarts replay from the first record.
+void CReplayLink::rewind()
+{
+	m_pos = m_len ? 4 : 0;
+	m_records = 0;
+	m_mismatches = 0;
+	m_read = 0;
+	m_readLen = 0;
+}
+
+// Decodes the header of the next record without consuming it.
+bool CReplayLink::peek(byte& type, uint32_t& dt, uint32_t& len, uint32_t& offset)
+{
+	uint32_t pos = m_pos;
+	if (pos >= m_len) return false;
+	type = m_data[pos++];
+	uint32_t* fields[2] = {&dt, &len};
+	for (byte i = 0; i < 2; i++) {
+		uint32_t v = 0;
+		for (byte shift = 0; ; shift += 7) {
+			if (pos >= m_len || shift > 28) return false;
+			byte b = m_data[pos++];
+			v |= (uint32_t)(b & 0x7f) << shift;
+			if (!(b & 0x80)) break;
+		}
+		*fields[i] = v;
+	}
+	if (len > m_len - pos) return false;
+	offset = pos;
+	return true;
+}
+
+// Consumes the peeked record; replies wait for their recorded latency in real-time mode.
+void CReplayLink::consume(byte type, uint32_t dt, uint32_t offset, uint32_t len)
+{
+	m_pos = offset + len;
+	m_records++;
+	if (m_realtime && type != TRACE_SEND && dt) delay(dt);
+}
+
+// Replays a command and its recorded reply.
+int CReplayLink::sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+{
+	send(cmd);
+	return receive(buf, bufsize, timeout);
+}
+
+// Returns the next recorded reply, or 0 if the trace expects a command first.
+int CReplayLink::receive(char* buffer, int bufsize, unsigned int timeout)
+{
+	byte type;
+	uint32_t dt, len, offset;
+	m_readLen = 0;
+	if (bufsize <= 0 || !peek(type, dt, len, offset) || type != TRACE_RECV) return 0;
+	consume(type, dt, offset, len);
+	int n = len < (uint32_t)bufsize - 1 ? len : bufsize - 1;
+	memcpy(buffer, m_data + offset, n);
+	buffer[n] = 0;
+	return n;
+}
+
+// Skips to the next recorded command and compares it with str.
+bool CReplayLink::send(const char* str)
+{
+	byte type;
+	uint32_t dt, len, offset;
+	m_readLen = 0;
+	while (peek(type, dt, len, offset)) {
+		consume(TRACE_SEND, dt, offset, len);
+		if (type != TRACE_SEND) continue;
+		if (len != strlen(str) || memcmp(m_data + offset, str, len)) m_mismatches++;
+		return true;
+	}
+	// trace exhausted
+	m_mismatches++;
+	return true;
+}
+
+// Returns the next recorded byte, or -1 when no read() bytes are pending.
+int CReplayLink::read()
+{
+	if (!m_readLen) {
+		byte type;
+		uint32_t dt, len, offset;
+		if (!peek(type, dt, len, offset) || type != TRACE_READ) return -1;
+		consume(type, dt, offset, len);
+		m_read = m_data + offset;
+		m_readLen = len;
+		if (!len) return -1;
+	}
+	m_readLen--;
+	return *m_read++;
+}
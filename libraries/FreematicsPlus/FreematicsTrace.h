@@ -0,0 +1,126 @@
+/*************************************************************************
+* Adapter conversation trace recording and replay for Freematics ONE+
+* Distributed under BSD license
+* Visit https://freematics.com for more information
+*************************************************************************/
+
+#ifndef FREEMATICS_TRACE
+#define FREEMATICS_TRACE
+
+#include "FreematicsBase.h"
+
+/*
+ * Trace format: the 4-byte magic "FTR1", then one record per link operation:
+ *   type (1 byte), delta time in ms since the previous record (varint),
+ *   payload length (varint), payload bytes.
+ * Varints are little-endian base 128 (7 bits per byte, high bit = more).
+ */
+#define TRACE_MAGIC "FTR1"
+#define TRACE_SEND 'S' /* bytes written to the adapter */
+#define TRACE_RECV 'R' /* reply returned by receive()/sendCommand(), empty on timeout */
+#define TRACE_READ 'B' /* bytes returned by consecutive read() calls */
+#define TRACE_BUFFER_SIZE 1024 /* records buffered in RAM before they are written out */
+#define TRACE_MAX_READ 64 /* read() bytes coalesced into one record */
+
+/**
+ * @brief CLink decorator recording every adapter command and reply.
+ *
+ * All calls are forwarded to the wrapped link. Records are buffered and
+ * written to the attached output (e.g. an SD file) when the buffer fills
+ * or on flush().
+ */
+class CTraceLink : public CLink
+{
+public:
+	/**
+	 * @brief Sets the link whose conversation is recorded.
+	 */
+	void wrap(CLink* link) { m_link = link; }
+	/**
+	 * @brief Starts recording into @p out, writing the trace header first.
+	 * @param out Trace output, or 0 to stop recording.
+	 */
+	void attach(Print* out);
+	/**
+	 * @brief Writes buffered records to the output.
+	 */
+	void flush();
+	/**
+	 * @brief Number of trace bytes written or buffered since attach().
+	 */
+	uint32_t size() const { return m_size; }
+	bool begin(unsigned int baudrate = 0, int rxPin = 0, int txPin = 0) { return m_link && m_link->begin(baudrate, rxPin, txPin); }
+	void end() { if (m_link) m_link->end(); }
+	int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout);
+	int receive(char* buffer, int bufsize, unsigned int timeout);
+	bool send(const char* str);
+	int read();
+private:
+	void record(byte type, const void* data, int len, uint32_t ts);
+	void putVarint(uint32_t value);
+	void putBytes(const void* data, int len);
+	void flushRead();
+	CLink* m_link = 0;
+	Print* m_out = 0;
+	uint32_t m_lastTime = 0;
+	uint32_t m_size = 0;
+	uint32_t m_readTime = 0;
+	uint16_t m_len = 0;
+	byte m_readLen = 0;
+	byte m_read[TRACE_MAX_READ];
+	byte m_buf[TRACE_BUFFER_SIZE];
+};
+
+/**
+ * @brief CLink that replays a recorded trace instead of talking to an adapter.
+ *
+ * Replies are served in recorded order. In real-time mode every reply is
+ * delayed by its recorded latency; otherwise it is returned immediately so
+ * the whole acquisition path can be benchmarked as fast as it parses.
+ * Runs anywhere millis()/delay() are available, including a host build.
+ */
+class CReplayLink : public CLink
+{
+public:
+	/**
+	 * @brief Attaches a trace image.
+	 * @param data Complete trace, starting with the TRACE_MAGIC header.
+	 * @param len Trace length in bytes.
+	 * @param realtime If true, replies are delayed by their recorded latency.
+	 * @return false if the header does not match.
+	 */
+	bool load(const byte* data, uint32_t len, bool realtime = false);
+	/**
+	 * @brief Restarts replay from the first record.
+	 */
+	void rewind();
+	/**
+	 * @brief True once every record has been consumed.
+	 */
+	bool done() const { return m_pos >= m_len; }
+	/**
+	 * @brief Number of send() calls that did not match the recorded command.
+	 */
+	uint32_t mismatches() const { return m_mismatches; }
+	/**
+	 * @brief Number of records consumed since load() or rewind().
+	 */
+	uint32_t records() const { return m_records; }
+	int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout);
+	int receive(char* buffer, int bufsize, unsigned int timeout);
+	bool send(const char* str);
+	int read();
+private:
+	bool peek(byte& type, uint32_t& dt, uint32_t& len, uint32_t& offset);
+	void consume(byte type, uint32_t dt, uint32_t offset, uint32_t len);
+	const byte* m_data = 0;
+	uint32_t m_len = 0;
+	uint32_t m_pos = 0;
+	uint32_t m_records = 0;
+	uint32_t m_mismatches = 0;
+	const byte* m_read = 0;
+	uint32_t m_readLen = 0;
+	bool m_realtime = false;
+};
+
+#endif
@@ -75,3 +75,26 @@ typedef enum {
     OBD_CONNECTED = 2,
     OBD_FAILED = 3
 } OBD_STATES;
+
+// link recovery steps, in escalating order
+typedef enum {
+    OBD_RECOVER_RESYNC = 1, // drain the link and probe the adapter
+    OBD_RECOVER_PROTOCOL = 2, // close and reopen the protocol (ATPC/ATSP)
+    OBD_RECOVER_RESET = 3 // full adapter reset and init
+} OBD_RECOVERY;
+
+// requests accepted by COBD::submit()
+typedef enum {
+    OBD_ASYNC_PID = 0, // mode 01 PIDs, decoded into result[]
+    OBD_ASYNC_CAN = 1, // raw CAN payload sent to canId, reply text kept
+    OBD_ASYNC_COMMAND = 2 // AT or hex command text, reply text kept
+} OBD_ASYNC_TYPE;
+
+// life cycle of a submitted request
+typedef enum {
+    OBD_ASYNC_FREE = 0,
+    OBD_ASYNC_QUEUED = 1,
+    OBD_ASYNC_SENT = 2,
+    OBD_ASYNC_DONE = 3,
+    OBD_ASYNC_FAILED = 4 // timeout, adapter error or no PID decoded
+} OBD_ASYNC_STATUS;
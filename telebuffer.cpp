@@ -0,0 +1,361 @@
+/******************************************************************************
+* Sample buffers queued between the acquisition and telemetry tasks
+* Distributed under BSD license
+******************************************************************************/
+
+#include <new>
+#include <assert.h>
+#include "serial_logging.h"
+#include "telestore.h"
+#include "telebuffer.h"
+#if BOARD_HAS_PSRAM
+#include <esp_heap_caps.h>
+#endif
+
+CBuffer::CBuffer(uint16_t index) : index(index)
+{
+  purge();
+}
+
+void CBuffer::add(uint16_t pid, uint8_t type, void* values, int bytes, uint8_t count)
+{
+  if (offset < BUFFER_LENGTH - sizeof(ELEMENT_HEAD) - bytes) {
+    ELEMENT_HEAD hdr = {pid, type, count};
+    *(ELEMENT_HEAD*)(m_data + offset) = hdr;
+    offset += sizeof(ELEMENT_HEAD);
+    memcpy(m_data + offset, values, bytes); 
+    offset += bytes;
+    total++;
+  } else {
+    serial_log_print(LOG_INFO, "FULL");
+  }
+}
+
+void CBuffer::purge()
+{
+  timestamp = 0;
+  offset = 0;
+  total = 0;
+}
+
+bool CBuffer::transition(uint8_t from, uint8_t to)
+{
+  uint8_t expected = from;
+  if (state.compare_exchange_strong(expected, to, std::memory_order_acq_rel)) return true;
+  // a slot handed over twice or freed by the wrong side
+  serial_log_printf(LOG_INFO, "[BUF] Slot %u state %u, expected %u", index, expected, from);
+  return false;
+}
+
+void CBuffer::serialize(CStorage& store)
+{
+  uint16_t of = 0;
+  for (int n = 0; n < total && of < offset; n++) {
+    ELEMENT_HEAD* hdr = (ELEMENT_HEAD*)(m_data + of);
+    of += sizeof(ELEMENT_HEAD);
+    switch (hdr->type) {
+    case ELEMENT_UINT8:
+      store.log(hdr->pid, (uint8_t*)(m_data + of), hdr->count);
+      of += (uint16_t)hdr->count * sizeof(uint8_t);
+      break;
+    case ELEMENT_UINT16:
+      store.log(hdr->pid, (uint16_t*)(m_data + of), hdr->count);
+      of += (uint16_t)hdr->count * sizeof(uint16_t);
+      break;
+    case ELEMENT_UINT32:
+      store.log(hdr->pid, (uint32_t*)(m_data + of), hdr->count);
+      of += (uint16_t)hdr->count * sizeof(uint32_t);
+      break;
+    case ELEMENT_INT32:
+      store.log(hdr->pid, (int32_t*)(m_data + of), hdr->count);
+      of += (uint16_t)hdr->count * sizeof(int32_t);
+      break;
+    case ELEMENT_FLOAT:
+      store.log(hdr->pid, (float*)(m_data + of), hdr->count);
+      of += (uint16_t)hdr->count * sizeof(float);
+      break;
+    case ELEMENT_FLOAT_D1:
+      store.log(hdr->pid, (float*)(m_data + of), hdr->count, "%.1f");
+      of += (uint16_t)hdr->count * sizeof(float);
+      break;
+    case ELEMENT_FLOAT_D2:
+      store.log(hdr->pid, (float*)(m_data + of), hdr->count, "%.2f");
+      of += (uint16_t)hdr->count * sizeof(float);
+      break;
+    default:
+      return;
+    }
+  }
+}
+
+void CBufferManager::init()
+{
+  total = BUFFER_SLOTS;
+#if BOARD_HAS_PSRAM
+  slots = (CBuffer*)heap_caps_malloc(BUFFER_SLOTS * sizeof(CBuffer), MALLOC_CAP_SPIRAM);
+#else
+  slots = (CBuffer*)malloc(BUFFER_SLOTS * sizeof(CBuffer));
+#endif
+  for (int n = 0; n < BUFFER_SLOTS; n++) new (&slots[n]) CBuffer(n);
+  m_scratch = (uint8_t*)malloc(BUFFER_LENGTH);
+  // take a smaller arena if RAM is short
+  for (m_arenaSize = BUFFER_ARENA_SIZE; m_arenaSize >= BUFFER_LENGTH * 2; m_arenaSize /= 2) {
+#if BOARD_HAS_PSRAM
+    m_arena = (uint8_t*)heap_caps_malloc(m_arenaSize, MALLOC_CAP_SPIRAM);
+#else
+    m_arena = (uint8_t*)malloc(m_arenaSize);
+#endif
+    if (m_arena) break;
+    serial_log_print(LOG_INFO, "OUT OF RAM");
+  }
+  assert(m_arena && m_scratch);
+  m_arenaHead = 0;
+  m_arenaTail = 0;
+  m_arenaUsed = 0;
+  // deque capacity is a power of two larger than the slot count, so head never reaches tail
+  uint32_t capacity = 2;
+  while (capacity <= total) capacity <<= 1;
+  m_mask = capacity - 1;
+#if BOARD_HAS_PSRAM
+  m_queue = (std::atomic<uint16_t>*)heap_caps_malloc(capacity * sizeof(std::atomic<uint16_t>), MALLOC_CAP_SPIRAM);
+  m_next = (std::atomic<uint16_t>*)heap_caps_malloc(total * sizeof(std::atomic<uint16_t>), MALLOC_CAP_SPIRAM);
+#else
+  m_queue = (std::atomic<uint16_t>*)malloc(capacity * sizeof(std::atomic<uint16_t>));
+  m_next = (std::atomic<uint16_t>*)malloc(total * sizeof(std::atomic<uint16_t>));
+#endif
+  for (uint32_t n = 0; n < capacity; n++) new (&m_queue[n]) std::atomic<uint16_t>(BUFFER_NONE);
+  for (uint32_t n = 0; n < total; n++) new (&m_next[n]) std::atomic<uint16_t>(BUFFER_NONE);
+  m_ends.store(0);
+  m_freeTop.store(BUFFER_NONE);
+  m_commits.store(0);
+  m_dropped.store(0);
+  m_returned.store(BUFFER_NONE);
+  for (int n = total - 1; n >= 0; n--) pushFree(n);
+}
+
+void CBufferManager::purge()
+{
+  uint16_t index = m_returned.exchange(BUFFER_NONE, std::memory_order_acquire);
+  if (index != BUFFER_NONE) release(&slots[index], BUFFER_STATE_FILLED);
+  while (pop(false, index)) release(&slots[index], BUFFER_STATE_FILLED);
+}
+
+CBuffer* CBufferManager::acquire()
+{
+  for (;;) {
+    uint16_t index = popFree();
+    uint8_t from = BUFFER_STATE_EMPTY;
+    if (index == BUFFER_NONE && pop(false, index)) {
+      // no free slot, dispose oldest data
+      m_dropped.fetch_add(1, std::memory_order_relaxed);
+      from = BUFFER_STATE_FILLED;
+    }
+    if (index != BUFFER_NONE) {
+      CBuffer* slot = &slots[index];
+      // a slot in any other state belongs to the consumer, which returns it itself
+      if (!slot->transition(from, BUFFER_STATE_FILLING)) continue;
+      slot->purge();
+      slot->m_data = m_scratch;
+      return slot;
+    }
+    // the consumer emptied the queue and is returning slots to the free list
+  }
+}
+
+void CBufferManager::commit(CBuffer* slot)
+{
+  if (!slot->transition(BUFFER_STATE_FILLING, BUFFER_STATE_FILLED)) return;
+  // a buffer the consumer failed to send goes back first, so the arena can evict it if needed
+  uint16_t returned = m_returned.exchange(BUFFER_NONE, std::memory_order_acquire);
+  if (returned != BUFFER_NONE) pushNewest(returned);
+  ARENA_HEAD* rec = alloc((sizeof(ARENA_HEAD) + slot->offset + 3) & ~3);
+  if (!rec) {
+    // the consumer is sending the oldest buffer, so nothing can be overwritten right now
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    release(slot, BUFFER_STATE_FILLED);
+    return;
+  }
+  rec->slot = slot->index;
+  memcpy(rec + 1, slot->m_data, slot->offset);
+  slot->m_data = (uint8_t*)(rec + 1);
+  pushNewest(slot->index);
+  m_commits.fetch_add(1, std::memory_order_release);
+}
+
+void CBufferManager::pushNewest(uint16_t index)
+{
+  // producer only, since nothing else writes the cell at head
+  uint32_t ends = m_ends.load(std::memory_order_acquire);
+  for (;;) {
+    uint16_t head = ends >> 16;
+    // the cell at head is outside the queued range until the CAS publishes it
+    m_queue[head & m_mask].store(index, std::memory_order_relaxed);
+    uint32_t next = (uint32_t)(uint16_t)(head + 1) << 16 | (ends & 0xffff);
+    if (m_ends.compare_exchange_weak(ends, next, std::memory_order_release, std::memory_order_acquire)) return;
+  }
+}
+
+void CBufferManager::pushOldest(uint16_t index)
+{
+  // consumer only
+  uint32_t ends = m_ends.load(std::memory_order_acquire);
+  for (;;) {
+    uint16_t tail = (uint16_t)ends - 1;
+    // only the consumer moves the tail backwards and the producer only writes the cell at head,
+    // which is never this one while the deque has room for every slot
+    m_queue[tail & m_mask].store(index, std::memory_order_relaxed);
+    uint32_t next = (ends & 0xffff0000) | tail;
+    if (m_ends.compare_exchange_weak(ends, next, std::memory_order_release, std::memory_order_acquire)) return;
+  }
+}
+
+bool CBufferManager::pop(bool newest, uint16_t& index)
+{
+  uint32_t ends = m_ends.load(std::memory_order_acquire);
+  for (;;) {
+    uint16_t head = ends >> 16;
+    uint16_t tail = ends & 0xffff;
+    if (head == tail) return false;
+    // read the slot number first; the CAS only succeeds if nobody moved either end meanwhile
+    uint16_t pos = newest ? head - 1 : tail;
+    uint16_t n = m_queue[pos & m_mask].load(std::memory_order_relaxed);
+    uint32_t next = newest ? ((uint32_t)pos << 16 | tail) : ((ends & 0xffff0000) | (uint16_t)(tail + 1));
+    if (m_ends.compare_exchange_weak(ends, next, std::memory_order_acq_rel, std::memory_order_acquire)) {
+      index = n;
+      return true;
+    }
+  }
+}
+
+CBuffer* CBufferManager::take(bool newest)
+{
+  uint16_t index;
+  while (pop(newest, index)) {
+    if (slots[index].transition(BUFFER_STATE_FILLED, BUFFER_STATE_LOCKED)) return &slots[index];
+  }
+  return 0;
+}
+
+void CBufferManager::free(CBuffer* slot)
+{
+  release(slot, slot->state.load(std::memory_order_acquire) == BUFFER_STATE_FILLING ? BUFFER_STATE_FILLING : BUFFER_STATE_LOCKED);
+}
+
+void CBufferManager::restore(CBuffer* slot)
+{
+  if (!slot->transition(BUFFER_STATE_LOCKED, BUFFER_STATE_FILLED)) return;
+  pushOldest(slot->index);
+}
+
+void CBufferManager::restoreNewest(CBuffer* slot)
+{
+  if (!slot->transition(BUFFER_STATE_LOCKED, BUFFER_STATE_FILLED)) return;
+  // the consumer takes a newest buffer only after a commit, which has emptied the hand-over
+  uint16_t index = m_returned.exchange(slot->index, std::memory_order_release);
+  if (index != BUFFER_NONE) pushOldest(index);
+}
+
+void CBufferManager::release(CBuffer* slot, uint8_t from)
+{
+  if (!slot->transition(from, BUFFER_STATE_EMPTY)) return;
+  // the fields are left as they are: acquire() clears them, and printStats() may be
+  // reading them on the producer while the consumer returns the slot
+  pushFree(slot->index);
+}
+
+uint16_t CBufferManager::queued() const
+{
+  uint32_t ends = m_ends.load(std::memory_order_acquire);
+  return (uint16_t)((ends >> 16) - ends);
+}
+
+uint16_t CBufferManager::popFree()
+{
+  uint32_t top = m_freeTop.load(std::memory_order_acquire);
+  for (;;) {
+    uint16_t index = top & 0xffff;
+    if (index == BUFFER_NONE) return BUFFER_NONE;
+    // the tag changes on every push and pop, so a stale link fails the CAS
+    uint32_t next = ((top & 0xffff0000) + 0x10000) | m_next[index].load(std::memory_order_relaxed);
+    if (m_freeTop.compare_exchange_weak(top, next, std::memory_order_acq_rel, std::memory_order_acquire)) return index;
+  }
+}
+
+void CBufferManager::pushFree(uint16_t index)
+{
+  uint32_t top = m_freeTop.load(std::memory_order_acquire);
+  do {
+    m_next[index].store(top & 0xffff, std::memory_order_relaxed);
+  } while (!m_freeTop.compare_exchange_weak(top, ((top & 0xffff0000) + 0x10000) | index,
+    std::memory_order_release, std::memory_order_acquire));
+}
+
+void CBufferManager::printStats()
+{
+  if (!slots) return;
+  int bytes = 0;
+  int samples = 0;
+  uint32_t ends = m_ends.load(std::memory_order_acquire);
+  uint16_t count = (uint16_t)((ends >> 16) - ends);
+  for (uint16_t pos = ends & 0xffff, n = 0; n < count; pos++, n++) {
+    const CBuffer* slot = &slots[m_queue[pos & m_mask].load(std::memory_order_relaxed)];
+    bytes += slot->offset;
+    samples += slot->total;
+  }
+  serial_log_printf(LOG_INFO, "[BUF] %d samples | %d bytes | %u/%lu | arena %lu/%lu | %lu dropped",
+    samples, bytes, count, (unsigned long)total, (unsigned long)m_arenaUsed, (unsigned long)m_arenaSize,
+    (unsigned long)dropped());
+}
+
+void CBufferManager::reclaim()
+{
+  // records are reclaimed in arena order; one still queued or being sent stops the walk
+  while (m_arenaUsed) {
+    const ARENA_HEAD* rec = (const ARENA_HEAD*)(m_arena + m_arenaTail);
+    if (rec->slot != BUFFER_NONE) {
+      const CBuffer& slot = slots[rec->slot];
+      if (slot.m_data == (const uint8_t*)(rec + 1) && slot.state.load(std::memory_order_acquire) != BUFFER_STATE_EMPTY) break;
+    }
+    m_arenaTail += rec->size;
+    if (m_arenaTail == m_arenaSize) m_arenaTail = 0;
+    m_arenaUsed -= rec->size;
+  }
+  // an empty arena starts over to offer the longest contiguous space
+  if (!m_arenaUsed) m_arenaHead = m_arenaTail = 0;
+}
+
+ARENA_HEAD* CBufferManager::alloc(uint16_t size)
+{
+  for (;;) {
+    reclaim();
+    if (!m_arenaUsed || m_arenaHead > m_arenaTail) {
+      uint32_t end = m_arenaSize - m_arenaHead;
+      if (size <= end) return place(size);
+      if (size <= m_arenaTail) {
+        // pad the end of the arena and continue from its start (sizes are multiples of 4)
+        ARENA_HEAD* pad = place(end);
+        pad->slot = BUFFER_NONE;
+        return place(size);
+      }
+    } else if (size <= m_arenaTail - m_arenaHead) {
+      return place(size);
+    }
+    // the oldest record is the oldest queued buffer unless the consumer is sending it
+    const ARENA_HEAD* oldest = (const ARENA_HEAD*)(m_arena + m_arenaTail);
+    if (slots[oldest->slot].state.load(std::memory_order_acquire) == BUFFER_STATE_LOCKED) return 0;
+    uint16_t index;
+    if (!pop(false, index)) return 0;
+    m_dropped.fetch_add(1, std::memory_order_relaxed);
+    release(&slots[index], BUFFER_STATE_FILLED);
+  }
+}
+
+ARENA_HEAD* CBufferManager::place(uint16_t size)
+{
+  ARENA_HEAD* rec = (ARENA_HEAD*)(m_arena + m_arenaHead);
+  rec->size = size;
+  m_arenaHead += size;
+  if (m_arenaHead == m_arenaSize) m_arenaHead = 0;
+  m_arenaUsed += size;
+  return rec;
+}
@@ -0,0 +1,129 @@
+/******************************************************************************
+* Sample buffers queued between the acquisition and telemetry tasks
+* Distributed under BSD license
+******************************************************************************/
+
+#ifndef TELEBUFFER_H_INCLUDED
+#define TELEBUFFER_H_INCLUDED
+
+#include "config.h"
+#include <stdint.h>
+#include <atomic>
+
+class CStorage;
+
+// buffer ownership: EMPTY (free list) -> FILLING (producer) -> FILLED (queued) -> LOCKED (consumer) -> EMPTY
+#define BUFFER_STATE_EMPTY 0
+#define BUFFER_STATE_FILLING 1
+#define BUFFER_STATE_FILLED 2
+#define BUFFER_STATE_LOCKED 3
+
+#define ELEMENT_UINT8 0
+#define ELEMENT_UINT16 1
+#define ELEMENT_UINT32 2
+#define ELEMENT_INT32 3
+#define ELEMENT_FLOAT 4
+#define ELEMENT_FLOAT_D1 5 /* floating-point data with 1 decimal place*/
+#define ELEMENT_FLOAT_D2 6 /* floating-point data with 2 decimal places*/
+
+typedef struct {
+    uint16_t pid;
+    uint8_t type;
+    uint8_t count;
+} ELEMENT_HEAD;
+
+// header of a buffer stored in the arena, followed by the buffer's elements
+typedef struct {
+    uint16_t size; /* record bytes including this header, multiple of 4 */
+    uint16_t slot; /* owning slot number, BUFFER_NONE for the padding before a wrap */
+} ARENA_HEAD;
+
+class CBuffer
+{
+public:
+    CBuffer(uint16_t index);
+    void add(uint16_t pid, uint8_t type, void* values, int bytes, uint8_t count = 1);
+    // clears the content; the state is changed by CBufferManager only
+    void purge();
+    void serialize(CStorage& store);
+    // atomically moves the state from one value to another, false if it was not in state from
+    bool transition(uint8_t from, uint8_t to);
+    uint32_t timestamp;
+    uint16_t offset;
+    uint8_t total;
+    std::atomic<uint8_t> state{BUFFER_STATE_EMPTY};
+    const uint16_t index; // slot number in CBufferManager
+private:
+    friend class CBufferManager;
+    uint8_t* m_data = 0;  // producer scratch while filling, arena record once committed
+};
+
+#define BUFFER_NONE 0xffff /* no slot (empty free list) */
+
+// Queue of filled buffers between process() (producer) and the telemetry task (consumer).
+// Filled slots are kept in arrival order in a deque of slot numbers whose head and tail share one
+// atomic word, so every operation is O(1) and lock-free. Unused slots sit on a lock-free free list.
+// A buffer is filled in a scratch area of BUFFER_LENGTH bytes; commit() copies exactly the bytes
+// used into a ring-allocated arena, so short buffers no longer waste a fixed-size slot.
+class CBufferManager
+{
+public:
+    void init();
+    // drops every queued buffer (safe from either task)
+    void purge();
+    // producer: takes an empty buffer; if none is free, the oldest queued buffer is overwritten
+    CBuffer* acquire();
+    // producer: stores a filled buffer in the arena, overwriting the oldest queued buffers if
+    // needed, and queues it behind the ones already queued
+    void commit(CBuffer* slot);
+    // consumer: takes the oldest or newest queued buffer, 0 if none is queued
+    CBuffer* getOldest() { return take(false); }
+    CBuffer* getNewest() { return take(true); }
+    // returns a taken (LOCKED) or acquired (FILLING) buffer to the free list
+    void free(CBuffer* slot);
+    // consumer: re-queues a taken buffer that could not be sent as the oldest one, so it is taken
+    // again first by getOldest()
+    void restore(CBuffer* slot);
+    // consumer: re-queues a taken buffer that could not be sent as the newest one; it is handed
+    // to the producer, which queues it ahead of its next commit and thus behind any buffers
+    // committed while it was being sent
+    void restoreNewest(CBuffer* slot);
+    // number of queued buffers
+    uint16_t queued() const;
+    // queued buffers overwritten (or new ones discarded) for lack of room since init()
+    uint32_t dropped() const { return m_dropped.load(std::memory_order_relaxed); }
+    // buffers committed since init(); a change tells the consumer that fresh data is queued
+    uint32_t commits() const { return m_commits.load(std::memory_order_acquire); }
+    void printStats();
+private:
+    CBuffer* take(bool newest);
+    void release(CBuffer* slot, uint8_t from);
+    bool pop(bool newest, uint16_t& index);
+    void pushNewest(uint16_t index);
+    void pushOldest(uint16_t index);
+    uint16_t popFree();
+    void pushFree(uint16_t index);
+    // arena, producer side only
+    void reclaim();
+    ARENA_HEAD* alloc(uint16_t size);
+    ARENA_HEAD* place(uint16_t size);
+    CBuffer* slots = 0;
+    uint8_t* m_scratch = 0;
+    uint8_t* m_arena = 0;
+    uint32_t m_arenaSize = 0;
+    uint32_t m_arenaHead = 0;              // next record
+    uint32_t m_arenaTail = 0;              // oldest record not yet reclaimed
+    uint32_t m_arenaUsed = 0;
+    // cells are atomic since a losing CAS may have read one the other side is rewriting
+    std::atomic<uint16_t>* m_queue = 0;    // slot numbers in arrival order
+    std::atomic<uint16_t>* m_next = 0;     // free list links
+    uint16_t m_mask = 0;                   // deque capacity - 1 (power of two above total)
+    std::atomic<uint32_t> m_ends{0};       // deque head << 16 | tail, positions wrap at 65536
+    std::atomic<uint32_t> m_freeTop{BUFFER_NONE}; // ABA tag << 16 | first free slot
+    std::atomic<uint32_t> m_dropped{0};
+    std::atomic<uint32_t> m_commits{0};
+    std::atomic<uint16_t> m_returned{BUFFER_NONE}; // buffer from restoreNewest() not queued yet
+    uint32_t total = 0;
+};
+
+#endif // TELEBUFFER_H_INCLUDED
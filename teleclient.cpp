@@ -27,185 +27,6 @@ extern char vin[];
 extern GPS_DATA* gd;
 extern char isoTime[];
 
-CBuffer::CBuffer(uint8_t* mem)
-{
-  m_data = mem;
-  purge();
-}
-
-void CBuffer::add(uint16_t pid, uint8_t type, void* values, int bytes, uint8_t count)
-{
-  if (offset < BUFFER_LENGTH - sizeof(ELEMENT_HEAD) - bytes) {
-    ELEMENT_HEAD hdr = {pid, type, count};
-    *(ELEMENT_HEAD*)(m_data + offset) = hdr;
-    offset += sizeof(ELEMENT_HEAD);
-    memcpy(m_data + offset, values, bytes); 
-    offset += bytes;
-    total++;
-  } else {
-    serial_log_print(LOG_INFO, "FULL");
-  }
-}
-
-void CBuffer::purge()
-{
-  state = BUFFER_STATE_EMPTY;
-  timestamp = 0;
-  offset = 0;
-  total = 0;
-}
-
-void CBuffer::serialize(CStorage& store)
-{
-  uint16_t of = 0;
-  for (int n = 0; n < total && of < offset; n++) {
-    ELEMENT_HEAD* hdr = (ELEMENT_HEAD*)(m_data + of);
-    of += sizeof(ELEMENT_HEAD);
-    switch (hdr->type) {
-    case ELEMENT_UINT8:
-      store.log(hdr->pid, (uint8_t*)(m_data + of), hdr->count);
-      of += (uint16_t)hdr->count * sizeof(uint8_t);
-      break;
-    case ELEMENT_UINT16:
-      store.log(hdr->pid, (uint16_t*)(m_data + of), hdr->count);
-      of += (uint16_t)hdr->count * sizeof(uint16_t);
-      break;
-    case ELEMENT_UINT32:
-      store.log(hdr->pid, (uint32_t*)(m_data + of), hdr->count);
-      of += (uint16_t)hdr->count * sizeof(uint32_t);
-      break;
-    case ELEMENT_INT32:
-      store.log(hdr->pid, (int32_t*)(m_data + of), hdr->count);
-      of += (uint16_t)hdr->count * sizeof(int32_t);
-      break;
-    case ELEMENT_FLOAT:
-      store.log(hdr->pid, (float*)(m_data + of), hdr->count);
-      of += (uint16_t)hdr->count * sizeof(float);
-      break;
-    case ELEMENT_FLOAT_D1:
-      store.log(hdr->pid, (float*)(m_data + of), hdr->count, "%.1f");
-      of += (uint16_t)hdr->count * sizeof(float);
-      break;
-    case ELEMENT_FLOAT_D2:
-      store.log(hdr->pid, (float*)(m_data + of), hdr->count, "%.2f");
-      of += (uint16_t)hdr->count * sizeof(float);
-      break;
-    default:
-      return;
-    }
-  }
-}
-
-void CBufferManager::init()
-{
-  total = BUFFER_SLOTS;
-#if BOARD_HAS_PSRAM
-    slots = (CBuffer**)heap_caps_malloc(BUFFER_SLOTS * sizeof(void*), MALLOC_CAP_SPIRAM);
-#else
-    slots = (CBuffer**)malloc(BUFFER_SLOTS * sizeof(void*));
-#endif
-  for (int n = 0; n < BUFFER_SLOTS; n++) {
-    void* mem;
-#if BOARD_HAS_PSRAM
-    mem = heap_caps_malloc(BUFFER_LENGTH, MALLOC_CAP_SPIRAM);
-#else
-    mem = malloc(BUFFER_LENGTH);
-#endif
-    if (!mem) {
-      serial_log_print(LOG_INFO, "OUT OF RAM");
-      total = n;
-      break;
-    }
-    slots[n] = new CBuffer((uint8_t*)mem);
-  }
-  assert(total > 0);
-}
-
-void CBufferManager::purge()
-{
-  for (int n = 0; n < total; n++) slots[n]->purge();
-}
-
-CBuffer* CBufferManager::getFree()
-{
-  if (last) {
-    CBuffer* slot = last;
-    last = 0;
-    if (slot->state == BUFFER_STATE_EMPTY) return slot;
-  }
-  uint32_t ts = 0xffffffff;
-  int m = 0;
-  // search for free slot, if none, mark the oldest one
-  for (int n = 0; n < total; n++) {
-    if (slots[n]->state == BUFFER_STATE_EMPTY) {
-      return slots[n];
-    } else if (slots[n]->state == BUFFER_STATE_FILLED && slots[n]->timestamp < ts) {
-        m = n;
-        ts = slots[n]->timestamp;
-    }
-  }
-  // dispose oldest data when buffer is full
-  while (slots[m]->state == BUFFER_STATE_LOCKED) delay(1);
-  slots[m]->purge();
-  return slots[m];
-}
-
-CBuffer* CBufferManager::getOldest()
-{
-  uint32_t ts = 0xffffffff;
-  int m = -1;
-  for (int n = 0; n < total; n++) {
-    if (slots[n]->state == BUFFER_STATE_FILLED && slots[n]->timestamp < ts) {
-        m = n;
-        ts = slots[n]->timestamp;
-    }
-  }
-  if (m >= 0) {
-    slots[m]->state = BUFFER_STATE_LOCKED;
-    return slots[m];
-  }
-  return 0;
-}
-
-CBuffer* CBufferManager::getNewest()
-{
-  uint32_t ts = 0;
-  int m = -1;
-  for (int n = 0; n < total; n++) {
-    if (slots[n]->state == BUFFER_STATE_FILLED && slots[n]->timestamp > ts) {
-      m = n;
-      ts = slots[n]->timestamp;
-    }
-  }
-  if (m >= 0) {
-    slots[m]->state = BUFFER_STATE_LOCKED;
-    return slots[m];
-  }
-  return 0;
-}
-
-void CBufferManager::free(CBuffer* slot)
-{
-  slot->purge();
-  last = slot;  
-}
-
-void CBufferManager::printStats()
-{
-  int bytes = 0;
-  int count = 0;
-  int samples = 0;
-  for (int n = 0; n < total; n++) {
-    if (slots[n]->state != BUFFER_STATE_FILLED) continue;
-    bytes += slots[n]->offset;
-    samples += slots[n]->total;
-    count++;
-  }
-  if (slots) {
-    serial_log_printf(LOG_INFO, "[BUF] %d samples | %d bytes | %d/%lu", samples, bytes, count, (unsigned long)total);
-  }
-}
-
 bool TeleClientUDP::verifyChecksum(char* data)
 {
   uint8_t sum = 0;
@@ -21,6 +21,8 @@
 #include "abrp.h"
 #include "config.h"
 #include "CAN-uds.h"
+#include "CAN-poll.h"
+#include "CAN-cache.h"
 #include "telestore.h"
 #include "teleclient.h"
 #if BOARD_HAS_PSRAM
@@ -45,26 +47,41 @@
 #define STATE_WORKING 0x100
 #define STATE_STANDBY 0x200
 
-typedef struct {
-  byte pid;
-  byte tier;
-  int value;
-  uint32_t ts;
-} PID_POLLING_INFO;
-
-PID_POLLING_INFO obdData[]= {
-  {PID_SPEED, 1},
-  {PID_RPM, 1},
-  {PID_THROTTLE, 1},
-  {PID_ENGINE_LOAD, 1},
-  {PID_FUEL_PRESSURE, 2},
-  {PID_TIMING_ADVANCE, 2},
-  {PID_COOLANT_TEMP, 3},
-  {PID_INTAKE_TEMP, 3},
+// request schedule; periods can be overridden in /cfg/poll.ini as <name>=<ms>
+PollEntry pollTable[] = {
+  // name, kind, CAN ID, PID/DID, period (ms), priority[, cache TTL (ms), cache flags]
+  {"speed", POLL_OBD_PID, 0, PID_SPEED, 1000, 0},
+  {"rpm", POLL_OBD_PID, 0, PID_RPM, 1000, 0},
+  {"throttle", POLL_OBD_PID, 0, PID_THROTTLE, 1000, 0},
+  {"load", POLL_OBD_PID, 0, PID_ENGINE_LOAD, 1000, 0},
+  {"fuel_pressure", POLL_OBD_PID, 0, PID_FUEL_PRESSURE, 2000, 1},
+  {"timing", POLL_OBD_PID, 0, PID_TIMING_ADVANCE, 2000, 1},
+  {"coolant", POLL_OBD_PID, 0, PID_COOLANT_TEMP, 5000, 2},
+  {"intake", POLL_OBD_PID, 0, PID_INTAKE_TEMP, 5000, 2},
+  {"bms_220101", POLL_UDS_DID, 0x7E4, 0x220101, 1000, 0},     // BMS: SOC, current, voltage
+  {"bms_220105", POLL_UDS_DID, 0x7E4, 0x220105, 300000, 2, 3600000, CACHE_IGNITION}, // BMS: SOH
+  {"vcms_22E001", POLL_UDS_DID, 0x744, 0x22E001, 10000, 1},   // VCMS
+  {"tpms_22C000", POLL_UDS_DID, 0x7A0, 0x22C000, 60000, 2, 120000}, // BDC-TPMS
+  {"aircon_220100", POLL_UDS_DID, 0x7B3, 0x220100, 10000, 1}, // AIRCON
+  {"cluster_22B002", POLL_UDS_DID, 0x7C6, 0x22B002, 300000, 2, 300000}, // CLUSTER: odometer
+  {"vcu_22E004", POLL_UDS_DID, 0x7E2, 0x22E004, 10000, 1},    // VCU
 };
+CPollScheduler poller;
+// latest PID values and DID replies, read by the BLE and HTTP handlers
+CResponseCache responseCache;
+// OBD samples handed from the acquisition task to process()
+CSampleRing obdSamples;
+#if ENABLE_OBD && DTC_SWEEP_INTERVAL
+CDtcSweep dtcSweep;
+#endif
 
 CBufferManager bufman;
 Task subtask;
+#if ENABLE_OBD
+Task obdTask;
+// serializes access to the co-processor link between the acquisition task and loop()
+Mutex obdLock;
+#endif
 
 #if ENABLE_MEMS
 float accBias[3] = {0}; // calibrated reference accelerometer data
@@ -100,8 +117,18 @@ char isoTime[32] = {0};
 // stats data
 uint32_t lastMotionTime = 0;
 uint32_t timeoutsOBD = 0;
+// current OBD recovery step and attempts per step (index 0 counts fallbacks to standby)
+uint8_t recoveryLevel = 0;
+uint16_t recoveryCount[OBD_RECOVER_RESET + 1] = {0};
 uint32_t timeoutsNet = 0;
 uint32_t lastStatsTime = 0;
+// buffers sent as live data and drained from the backlog, buffers put back after a failed send,
+// buffers dropped because they did not fit one packet, age of the last drained buffer (ms)
+uint32_t txLive = 0;
+uint32_t txDrained = 0;
+uint32_t txRestored = 0;
+uint32_t txOversize = 0;
+uint32_t backlogAge = 0;
 
 int32_t syncInterval = SERVER_SYNC_INTERVAL * 1000;
 int32_t dataInterval = 1000;
@@ -122,9 +149,10 @@ void processBLE(int timeout);
 class State {
 public:
   bool check(uint16_t flags) { return (m_state & flags) == flags; }
-  void set(uint16_t flags) { m_state |= flags; }
-  void clear(uint16_t flags) { m_state &= ~flags; }
-  uint16_t m_state = 0;
+  // atomic so the acquisition task and loop() can change flags concurrently
+  void set(uint16_t flags) { m_state.fetch_or(flags); }
+  void clear(uint16_t flags) { m_state.fetch_and((uint16_t)~flags); }
+  std::atomic<uint16_t> m_state{0};
 };
 
 FreematicsESP32 sys;
@@ -133,23 +161,27 @@ class OBD : public COBD
 {
 protected:
   /*
-   * Summary: Runs quick background tasks while waiting for OBD responses.
-   * Logic: Processes MEMS sampling and BLE commands to keep sensors and BLE responsive.
+   * Summary: Yields while waiting for OBD responses.
+   * Logic: Sleeps one tick so other tasks on the core can run.
    * Inputs: none.
    * Outputs: none.
-   * Notes: Called frequently during OBD communication idle time.
+   * Notes: Runs on the acquisition task, so MEMS and BLE are serviced by loop() instead.
    */
   void idleTasks()
   {
-    // do some quick tasks while waiting for OBD response
-#if ENABLE_MEMS
-    processMEMS(0);
-#endif
-    processBLE(0);
+    delay(1);
   }
 };
 
 OBD obd;
+#if OBD_WARM_START
+// survives ESP.restart() after wake-up
+RTC_DATA_ATTR OBD_WARM_STATE obdWarm;
+#endif
+#if ENABLE_OBD && ENABLE_CAN_TRACE && STORAGE == STORAGE_SD
+CTraceLink traceLink;
+File traceFile;
+#endif
 
 MEMS_I2C* mems = 0;
 
@@ -242,36 +274,78 @@ void processExtInputs(CBuffer* buffer)
 #if ENABLE_HTTPD
 /*
  * Summary: HTTP handler that returns the latest live telemetry data as JSON.
- * Logic: Serializes OBD, MEMS, and GPS data into a JSON object in the provided buffer.
+ * Logic: Serializes cached OBD PID values and UDS DID replies, MEMS, and GPS data into a JSON object
+ *        in the provided buffer.
  * Inputs: param (HTTP request context with output buffer and size).
  * Outputs: Returns FLAG_DATA_RAW; sets content length and JSON content type.
- * Notes: Uses global data snapshots (obdData, gd, accSum, accBias, etc.).
+ * Notes: Never touches the bus; only replies still within their cache TTL are listed, with their age.
  */
 int handlerLiveData(UrlHandlerParam* param)
 {
     char *buf = param->pucBuffer;
     int bufsize = param->bufSize;
     int n = snprintf(buf, bufsize, "{\"obd\":{\"vin\":\"%s\",\"battery\":%.1f,\"pid\":[", vin, batteryVoltage);
-    uint32_t t = millis();
-    for (int i = 0; i < sizeof(obdData) / sizeof(obdData[0]); i++) {
-        n += snprintf(buf + n, bufsize - n, "{\"pid\":%u,\"value\":%d,\"age\":%u},",
-            0x100 | obdData[i].pid, obdData[i].value, (unsigned int)(t - obdData[i].ts));
+    static CacheReply reply;
+    for (byte kind = POLL_OBD_PID; kind <= POLL_UDS_DID; kind++) {
+        if (kind == POLL_UDS_DID && n < bufsize) n += snprintf(buf + n, bufsize - n, "],\"did\":[");
+        bool first = true;
+        for (byte i = 0; i < responseCache.count() && n < bufsize - 16; i++) {
+            if (!responseCache.at(i, millis(), reply) || reply.kind != kind) continue;
+            if (!first) buf[n++] = ',';
+            first = false;
+            if (kind == POLL_OBD_PID) {
+                n += snprintf(buf + n, bufsize - n, "{\"pid\":%u,\"value\":%d,\"age\":%u}",
+                    0x100 | (unsigned int)reply.id, (int)reply.value, (unsigned int)reply.age);
+                continue;
+            }
+            n += snprintf(buf + n, bufsize - n, "{\"can\":%u,\"did\":%u,\"age\":%u,\"data\":\"",
+                (unsigned int)reply.canId, (unsigned int)reply.id, (unsigned int)reply.age);
+            for (uint16_t j = 0; j < reply.len && n < bufsize - 8; j++) {
+                n += snprintf(buf + n, bufsize - n, "%02X", reply.data[j]);
+            }
+            // snprintf returns the untruncated length, so n may already be past the end
+            if (n < bufsize) n += snprintf(buf + n, bufsize - n, "\"}");
+        }
     }
-    n--;
-    n += snprintf(buf + n, bufsize - n, "]}");
+    if (n < bufsize) n += snprintf(buf + n, bufsize - n, "]}");
 #if ENABLE_MEMS
-    if (accCount) {
+    if (accCount && n < bufsize) {
       n += snprintf(buf + n, bufsize - n, ",\"mems\":{\"acc\":[%d,%d,%d],\"stationary\":%u}",
           (int)((accSum[0] / accCount - accBias[0]) * 100), (int)((accSum[1] / accCount - accBias[1]) * 100), (int)((accSum[2] / accCount - accBias[2]) * 100),
           (unsigned int)(millis() - lastMotionTime));
     }
 #endif
-    if (gd && gd->ts) {
+    if (gd && gd->ts && n < bufsize) {
       n += snprintf(buf + n, bufsize - n, ",\"gps\":{\"utc\":\"%s\",\"lat\":%f,\"lng\":%f,\"alt\":%f,\"speed\":%f,\"sat\":%d,\"age\":%u}",
           isoTime, gd->lat, gd->lng, gd->alt, gd->speed, (int)gd->sat, (unsigned int)(millis() - gd->ts));
     }
-    buf[n++] = '}';
-    param->contentLength = n;
+    if (n < bufsize - 1) buf[n++] = '}';
+    param->contentLength = n < bufsize ? n : bufsize - 1;
+    param->contentType=HTTPFILETYPE_JSON;
+    return FLAG_DATA_RAW;
+}
+
+/*
+ * Summary: HTTP handler that returns learned OBD/UDS response timeouts as JSON.
+ * Logic: Lists every CAN ID/service pair tracked by COBD with its timeout, sample and miss counts.
+ * Inputs: param (HTTP request context with output buffer and size).
+ * Outputs: Returns FLAG_DATA_RAW; sets content length and JSON content type.
+ * Notes: A timeout of 0 means not enough responses were seen yet and the default applies.
+ */
+int handlerTimeouts(UrlHandlerParam* param)
+{
+    char *buf = param->pucBuffer;
+    int bufsize = param->bufSize;
+    byte count;
+    const OBD_LATENCY* stats = obd.getLatencyStats(count);
+    int n = snprintf(buf, bufsize, "{\"timeouts\":[");
+    for (byte i = 0; i < count && n < bufsize; i++) {
+        n += snprintf(buf + n, bufsize - n, "%s{\"can\":%u,\"service\":%u,\"timeout\":%u,\"samples\":%u,\"misses\":%u}",
+            i ? "," : "", (unsigned int)stats[i].canId, stats[i].service, stats[i].timeout, stats[i].samples, stats[i].misses);
+    }
+    if (n < bufsize) n += snprintf(buf + n, bufsize - n, "],\"recovery\":{\"resync\":%u,\"protocol\":%u,\"reset\":%u,\"standby\":%u}}",
+        recoveryCount[OBD_RECOVER_RESYNC], recoveryCount[OBD_RECOVER_PROTOCOL], recoveryCount[OBD_RECOVER_RESET], recoveryCount[0]);
+    param->contentLength = n < bufsize ? n : bufsize - 1;
     param->contentType=HTTPFILETYPE_JSON;
     return FLAG_DATA_RAW;
 }
@@ -281,48 +355,449 @@ int handlerLiveData(UrlHandlerParam* param)
   Reading and processing OBD data
 *******************************************************************************/
 #if ENABLE_OBD
+#if DTC_SWEEP_INTERVAL
 /*
- * Summary: Polls OBD PIDs and appends valid samples to the buffer.
- * Logic: Iterates configured PIDs by tier, reads one tier per call, updates timestamps and values.
- * Inputs: buffer (target buffer for OBD samples).
+ * Summary: Logs one DTC change found by the sweep and queues it for upload.
+ * Logic: Pushes the ECU's CAN ID and the code and status packed into one value as a pair.
+ * Inputs: canId (ECU request CAN ID), dtc (DTC record), cleared (true if no longer reported).
  * Outputs: none.
- * Notes: Updates lastMotionTime based on speed; increments timeouts on read failures.
+ * Notes: Called from the acquisition task; process() adds the samples to the current buffer.
  */
-void processOBD(CBuffer* buffer)
+void onDTCChange(uint32_t canId, const UdsDtc& dtc, bool cleared)
 {
-  static int idx[2] = {0, 0};
-  int tier = 1;
-  for (byte i = 0; i < sizeof(obdData) / sizeof(obdData[0]); i++) {
-    if (obdData[i].tier > tier) {
-        // reset previous tier index
-        idx[tier - 2] = 0;
-        // keep new tier number
-        tier = obdData[i].tier;
-        // move up current tier index
-        i += idx[tier - 2]++;
-        // check if into next tier
-        if (obdData[i].tier != tier) {
-            idx[tier - 2]= 0;
-            i--;
-            continue;
-        }
+  serial_log_printf(LOG_INFO, "[DTC] %X %06X status %02X %s", (unsigned int)canId, (unsigned int)dtc.code, dtc.status, cleared ? "cleared" : "set");
+  // both or neither, so a code is never attributed to the previous ECU
+  PollSample samples[2] = {
+    {PID_DTC_ECU, (int32_t)canId},
+    {(uint16_t)(cleared ? PID_DTC_CLEARED : PID_DTC), (int32_t)((dtc.code << 8) | dtc.status)}
+  };
+  obdSamples.push(samples, 2);
+}
+
+/*
+ * Summary: Sweeps the DTCs of every UDS ECU in pollTable and reports the changes.
+ * Logic: Runs CDtcSweep with DTC_STATUS_MASK; the sweep diffs against the previous result.
+ * Inputs: none.
+ * Outputs: none.
+ * Notes: Caller holds obdLock. Requests go back to back with learned per-ECU timeouts.
+ */
+void sweepDTC()
+{
+  uint32_t t = millis();
+  int changes = dtcSweep.sweep(DTC_STATUS_MASK, onDTCChange);
+  if (changes < 0) {
+    serial_log_print(LOG_INFO, "[DTC] No ECU answered");
+  } else {
+    serial_log_printf(LOG_INFO, "[DTC] %u ECUs, %u codes, %d changes in %lums",
+      dtcSweep.ecuCount(), dtcSweep.count(), changes, (unsigned long)(millis() - t));
+  }
+}
+#endif
+
+#if CAN_MONITOR_WINDOW
+/*
+ * Summary: Captures broadcast CAN frames in monitor mode and decodes them into abrpTelemetry.
+ * Logic: Puts the adapter into monitor mode for the broadcast IDs of the signal table,
+ *        decodes every frame as it arrives (latest value wins, stamped with its arrival time)
+ *        and leaves monitor mode again. Listens for CAN_MONITOR_WINDOW, or until the next poll
+ *        deadline when that is later (up to CAN_MONITOR_MAX_WINDOW), so idle bus time is captured.
+ * Inputs: none.
+ * Outputs: Returns the number of frames decoded.
+ * Notes: Does nothing when the vehicle table has no broadcast signals. The adapter cannot poll
+ *        while monitoring, so frames sent during polling are missed.
+ */
+int processCANMonitor()
+{
+  static uint32_t ids[16];
+  static int8_t idCount = -1;
+  if (idCount < 0) idCount = getBroadcastIds(ids, sizeof(ids) / sizeof(ids[0]));
+  if (!idCount || !obd.startMonitor(ids, idCount)) return 0;
+  int frames = 0;
+  uint32_t start = millis();
+  uint32_t window = poller.idleTime(start);
+  if (window > CAN_MONITOR_MAX_WINDOW) window = CAN_MONITOR_MAX_WINDOW;
+  if (window < CAN_MONITOR_WINDOW) window = CAN_MONITOR_WINDOW;
+  uint32_t elapsed;
+  while ((elapsed = millis() - start) < window) {
+    uint32_t id;
+    uint32_t stamp;
+    byte data[8];
+    int len = obd.receiveFrame(id, data, sizeof(data), window - elapsed, &stamp);
+    if (len && decodeAbrpTelemetry(id, CAN_SIGNAL_BROADCAST, data, len, abrpTelemetry)) {
+      abrpTelemetry.broadcast_ts = stamp;
+      frames++;
     }
-    byte pid = obdData[i].pid;
-    if (!obd.isValidPID(pid)) continue;
-    int value;
-    if (obd.readPID(pid, value)) {
-        obdData[i].ts = millis();
-        obdData[i].value = value;
-        buffer->add((uint16_t)pid | 0x100, ELEMENT_INT32, &value, sizeof(value));
-    } else {
+  }
+  obd.stopMonitor();
+  return frames;
+}
+#endif
+
+// supported signals of one vehicle, persisted in NVS as "support"
+struct SupportCache {
+  uint32_t table;                   // pollTableSignature() the DID flags refer to
+  char vin[18];                     // vehicle the cache belongs to
+  uint8_t pidmapValid;
+  byte pidmap[sizeof(COBD::pidmap)];
+  uint32_t didTested;               // pollTable entries answered or rejected at least once
+  uint32_t didMissing;              // pollTable entries the ECU rejected as unsupported
+} supportCache;
+// set once the cache was matched against this session's vehicle
+bool supportReady = false;
+static_assert(sizeof(pollTable) / sizeof(pollTable[0]) <= 32, "DID support flags are 32-bit");
+
+/*
+ * Summary: Computes a signature of the requests in pollTable.
+ * Logic: FNV-1a hash over kind, CAN ID and PID/DID of every entry.
+ * Inputs: none.
+ * Outputs: Returns the signature.
+ * Notes: A firmware with a different table invalidates the cached DID flags.
+ */
+uint32_t pollTableSignature()
+{
+  uint32_t h = 2166136261UL;
+  for (byte i = 0; i < sizeof(pollTable) / sizeof(pollTable[0]); i++) {
+    uint32_t v[3] = {pollTable[i].kind, pollTable[i].canId, pollTable[i].id};
+    for (byte j = 0; j < 3; j++) {
+      for (byte k = 0; k < 4; k++) {
+        h = (h ^ ((v[j] >> (k * 8)) & 0xff)) * 16777619UL;
+      }
+    }
+  }
+  return h;
+}
+
+/*
+ * Summary: Loads the supported signal cache from NVS.
+ * Logic: Reads the "support" blob and discards it if its size or table signature does not match.
+ * Inputs: none.
+ * Outputs: none.
+ * Notes: Called once at boot; the cache is matched to a vehicle in applySupportCache().
+ */
+void loadSupportCache()
+{
+  size_t len = sizeof(supportCache);
+  if (nvs_get_blob(nvs, "support", &supportCache, &len) != ESP_OK || len != sizeof(supportCache) ||
+      supportCache.table != pollTableSignature()) {
+    memset(&supportCache, 0, sizeof(supportCache));
+  }
+}
+
+/*
+ * Summary: Persists the supported signal cache to NVS.
+ * Logic: Writes the "support" blob and commits.
+ * Inputs: none.
+ * Outputs: none.
+ * Notes: Only written on discovery and on the first verdict per DID, so flash wear is bounded.
+ */
+void saveSupportCache()
+{
+  if (nvs_set_blob(nvs, "support", &supportCache, sizeof(supportCache)) == ESP_OK) nvs_commit(nvs);
+}
+
+/*
+ * Summary: Applies the cached supported PIDs of the connected vehicle or discovers them.
+ * Logic: Reuses the cached PID map when VIN and table signature match; otherwise resets the cache,
+ *        queries the supported PID ranges and saves the result.
+ * Inputs: vin (VIN of the connected vehicle, empty if unknown).
+ * Outputs: none.
+ * Notes: Caller holds obdLock. DID flags are learned later from the first reply to each DID.
+ */
+void applySupportCache(const char* vin)
+{
+  uint32_t table = pollTableSignature();
+  supportReady = true;
+  if (supportCache.table != table || strcmp(supportCache.vin, vin)) {
+    memset(&supportCache, 0, sizeof(supportCache));
+    supportCache.table = table;
+    strncpy(supportCache.vin, vin, sizeof(supportCache.vin) - 1);
+  } else if (supportCache.pidmapValid) {
+    obd.setPIDMap(supportCache.pidmap);
+    serial_log_print(LOG_INFO, "[OBD] Supported PIDs from cache");
+    return;
+  }
+  serial_log_print(LOG_INFO, "[OBD] Discovering supported PIDs");
+  if (obd.loadPIDMap()) {
+    memcpy(supportCache.pidmap, obd.pidmap, sizeof(supportCache.pidmap));
+    supportCache.pidmapValid = 1;
+  }
+  saveSupportCache();
+}
+
+/*
+ * Summary: Records whether the vehicle supports a pollTable DID after its first conclusive reply.
+ * Logic: A positive reply or a "not supported"/"out of range" negative response settles the DID once.
+ * Inputs: index (pollTable index), ok (DID was read), nrc (negative response code or 0).
+ * Outputs: none.
+ * Notes: Timeouts say nothing about support (the ECU may be asleep) and are not recorded.
+ */
+void noteDIDSupport(int index, bool ok, uint8_t nrc)
+{
+  uint32_t bit = 1UL << index;
+  if (!supportReady || (supportCache.didTested & bit)) return;
+  if (!ok && nrc != UDS_NRC_SERVICE_NOT_SUPPORTED && nrc != UDS_NRC_REQUEST_OUT_OF_RANGE) return;
+  supportCache.didTested |= bit;
+  if (!ok) {
+    supportCache.didMissing |= bit;
+    serial_log_printf(LOG_INFO, "[OBD] %s not supported", pollTable[index].name);
+  }
+  saveSupportCache();
+}
+
+#if LINK_UART_NEGOTIATE
+/*
+ * Summary: Raises the co-processor UART link to the fastest baud rate it carries reliably.
+ * Logic: Keeps the rate sys.begin() restored from NVS; otherwise probes LINK_UART_RATES fastest first
+ *        and saves the outcome, including the default rate when nothing faster verified.
+ * Inputs: saved (rate stored in NVS, 0 if never negotiated).
+ * Outputs: none.
+ * Notes: A stored rate that stops verifying (e.g. a new co-processor firmware) is probed again.
+ */
+void negotiateLinkBaudRate(uint32_t saved)
+{
+  static const unsigned int rates[] = LINK_UART_RATES;
+  unsigned int rate = sys.linkBaudRate();
+  if (!rate || rate == saved) return;
+  rate = sys.negotiateLinkBaudRate(rates, sizeof(rates) / sizeof(rates[0]));
+  serial_log_printf(LOG_INFO, "[LINK] %u bps", rate);
+  if (nvs_set_u32(nvs, "LINK_BAUD", rate) == ESP_OK) nvs_commit(nvs);
+}
+#endif
+
+/*
+ * Summary: Returns how long a reply of a pollTable entry is served from the response cache.
+ * Logic: Uses the entry's explicit TTL, or twice its period so a late poll does not expire the value.
+ * Inputs: e (pollTable entry).
+ * Outputs: Returns the TTL in ms.
+ * Notes: Only entries with an explicit TTL make processOBD() skip requests while cached.
+ */
+uint32_t cacheTTL(const PollEntry& e)
+{
+  return e.ttl ? e.ttl : e.period * 2;
+}
+
+/*
+ * Summary: Skips a due pollTable entry whose reply is still fresh in the cache.
+ * Logic: For entries with an explicit TTL, defers the deadline while the cached reply is younger
+ *        than min(period, TTL), so the TTL never stretches the refresh period and the period never
+ *        outlives the cached value.
+ * Inputs: index (pollTable index), now (current millis).
+ * Outputs: Returns true if the entry was deferred and must not be requested.
+ * Notes: Entries without an explicit TTL are always requested on schedule. The reply age is derived
+ *        from the remaining TTL, as the entry's own replies are cached with cacheTTL().
+ */
+bool deferCached(int index, uint32_t now)
+{
+  const PollEntry& e = poller.entry(index);
+  if (!e.ttl) return false;
+  uint32_t left = responseCache.remaining(e.kind, e.kind == POLL_UDS_DID ? e.canId : 0, e.id, now);
+  if (!left || left > e.ttl) return false;
+  uint32_t age = e.ttl - left;
+  uint32_t window = e.ttl < e.period ? e.ttl : e.period;
+  if (age >= window) return false;
+  poller.defer(index, now + window - age);
+  return true;
+}
+
+/*
+ * Summary: Stores a polled OBD PID value and queues it for the next data buffer.
+ * Logic: Puts the value into the response cache (used by live data queries) and pushes the sample to obdSamples.
+ * Inputs: e (pollTable entry of the PID), value (normalized value).
+ * Outputs: none.
+ * Notes: Updates lastMotionTime based on speed. The sample is dropped if process() falls behind.
+ */
+void storeOBDValue(const PollEntry& e, int value)
+{
+  byte pid = (byte)e.id;
+  responseCache.put(POLL_OBD_PID, 0, pid, value, 0, 0, cacheTTL(e), e.cacheFlags, millis());
+  obdSamples.push({(uint16_t)(pid | 0x100), value});
+  if (pid == PID_SPEED && value >= 2) lastMotionTime = millis();
+}
+
+/*
+ * Summary: Issues due OBD PID and UDS DID requests within the cycle time budget.
+ * Logic: Repeatedly takes the earliest-deadline entry that fits the remaining budget;
+ *        due OBD PIDs are combined into one multi-PID request.
+ * Inputs: none.
+ * Outputs: Returns the number of PID and DID values read successfully.
+ * Notes: Failed requests back off in the scheduler; OBD failures increment timeoutsOBD.
+ */
+int processOBD()
+{
+  int ok = 0;
+  uint32_t cycleStart = millis();
+  bool idle = true;
+  for (;;) {
+    uint32_t spent = millis() - cycleStart;
+    if (spent >= POLL_CYCLE_BUDGET) break;
+    // the first request of a cycle runs whatever its cost, so no entry starves
+    int first = poller.next(millis(), POLL_CYCLE_BUDGET - spent, idle);
+    if (first < 0) break;
+    uint32_t t = millis();
+    if (poller.entry(first).kind == POLL_OBD_PID) {
+      int slots[OBD_MAX_PIDS_PER_REQUEST];
+      byte pids[OBD_MAX_PIDS_PER_REQUEST];
+      int values[OBD_MAX_PIDS_PER_REQUEST];
+      bool success[OBD_MAX_PIDS_PER_REQUEST];
+      byte count = 0;
+      byte n = poller.collect(first, t, slots, OBD_MAX_PIDS_PER_REQUEST);
+      for (byte i = 0; i < n; i++) {
+        byte pid = (byte)poller.entry(slots[i]).id;
+        if (!obd.isValidPID(pid)) {
+          // unsupported by this vehicle, check again after a full backoff cycle
+          poller.complete(slots[i], false, t, 0);
+          continue;
+        }
+        if (deferCached(slots[i], t)) continue;
+        slots[count] = slots[i];
+        pids[count++] = pid;
+      }
+      if (!count) continue;
+      // functional OBD-II request, answered from 7E8-7EF (no-op unless a UDS read changed it)
+      obd.setCANID(0x7DF);
+      obd.setHeaderMask(0x7F8);
+      obd.setHeaderFilter(0x7E8);
+      obd.readPID(pids, count, values, success);
+      idle = false;
+      uint32_t elapsed = millis() - t;
+      if (!elapsed) elapsed = 1;
+      bool failed = false;
+      for (byte i = 0; i < count; i++) {
+        poller.complete(slots[i], success[i], millis(), elapsed);
+        if (success[i]) {
+          storeOBDValue(poller.entry(slots[i]), values[i]);
+          ok++;
+        } else {
+          failed = true;
+        }
+      }
+      if (failed) {
         timeoutsOBD++;
         printTimeoutStats();
-        break;
+      }
+    } else {
+      // read due DIDs of the same ECU back to back so the adapter header stays set
+      int slots[4];
+      byte n = poller.collect(first, t, slots, sizeof(slots) / sizeof(slots[0]));
+      for (byte i = 0; i < n; i++) {
+        const PollEntry& e = poller.entry(slots[i]);
+        uint32_t start = millis();
+        if (supportReady && (supportCache.didMissing & (1UL << slots[i]))) {
+          // unsupported by this vehicle, never sent
+          poller.complete(slots[i], false, start, 0);
+          continue;
+        }
+        if (deferCached(slots[i], start)) continue;
+        if (i > 0 && (start - cycleStart) + e.cost > POLL_CYCLE_BUDGET) break;
+        static uint8_t reply[UDS_BUFFER_SIZE];
+        uint8_t nrc;
+        int len = readUDS_DID(e.canId, e.id, reply, sizeof(reply), &nrc);
+        idle = false;
+        noteDIDSupport(slots[i], len > 0, nrc);
+        if (len) {
+          ok++;
+          responseCache.put(POLL_UDS_DID, e.canId, e.id, 0, reply, len, cacheTTL(e), e.cacheFlags, millis());
+          int signals = decodeAbrpTelemetry(e.canId, e.id, reply, len, abrpTelemetry);
+          serial_log_printf(LOG_INFO, "[UDS] %X %X: %d bytes, %d signals", (unsigned int)e.canId, (unsigned int)e.id, len, signals);
+        }
+        uint32_t elapsed = millis() - start;
+        poller.complete(slots[i], len > 0, millis(), elapsed ? elapsed : 1);
+      }
     }
-    if (tier > 1) break;
   }
-  int kph = obdData[0].value;
-  if (kph >= 2) lastMotionTime = millis();
+#if CAN_MONITOR_WINDOW
+  processCANMonitor();
+#endif
+  static uint32_t lastStats = 0;
+  if (cycleStart - lastStats >= POLL_STATS_INTERVAL) {
+    if (lastStats) poller.printStats(cycleStart);
+    lastStats = cycleStart;
+  }
+  return ok;
+}
+
+/*
+ * Summary: Escalates OBD link recovery one step each time errors reach MAX_OBD_ERRORS again.
+ * Logic: Resyncs the link first, then reopens the protocol, then resets the adapter; when the
+ *        reset fails too, clears STATE_OBD_READY and STATE_WORKING so loop() enters standby.
+ * Inputs: none.
+ * Outputs: none.
+ * Notes: recoveryLevel falls back to 0 once a cycle reads data again; attempts are counted per step.
+ */
+void recoverOBD()
+{
+  static const char* names[] = {"standby", "resync", "ATPC", "reset"};
+  if (recoveryLevel < OBD_RECOVER_RESET) recoveryLevel++;
+  recoveryCount[recoveryLevel]++;
+  bool ok = obd.recover((OBD_RECOVERY)recoveryLevel, PROTO_ISO15765_11B_500K);
+  serial_log_printf(LOG_INFO, "[OBD] Recovery %s #%u: %s", names[recoveryLevel], recoveryCount[recoveryLevel], ok ? "OK" : "failed");
+  if (!ok && recoveryLevel == OBD_RECOVER_RESET) {
+    recoveryCount[0]++;
+    recoveryLevel = 0;
+    serial_log_print(LOG_INFO, "[OBD] ECU OFF");
+    responseCache.setIgnition(false);
+    state.clear(STATE_OBD_READY | STATE_WORKING);
+  }
+}
+
+/*
+ * Summary: OBD/CAN acquisition task, decoupled from logging and network I/O.
+ * Logic: While working, runs processOBD() under obdLock, escalates link recovery after
+ *        repeated errors, retries a fast init when not connected and reads the battery voltage.
+ * Inputs: inst (Task instance, unused).
+ * Outputs: none.
+ * Notes: Clears STATE_OBD_READY and STATE_WORKING when the ECU stops answering; loop() then enters standby.
+ *        The state is checked again once obdLock is held, so a cycle never wakes an adapter standby() put to sleep.
+ */
+void obdAcquisition(void* inst)
+{
+  uint32_t lastInit = 0;
+  uint32_t lastVoltage = 0;
+#if DTC_SWEEP_INTERVAL
+  uint32_t lastSweep = 0;
+  bool swept = false;
+#endif
+  for (;;) {
+    if (!state.check(STATE_WORKING) || state.check(STATE_STANDBY)) {
+      delay(100);
+      continue;
+    }
+    obdLock.lock();
+    // standby() may have taken the lock and put the adapter to sleep since the check above
+    if (!state.check(STATE_WORKING) || state.check(STATE_STANDBY)) {
+      obdLock.unlock();
+      continue;
+    }
+    if (state.check(STATE_OBD_READY)) {
+      if (processOBD() > 0 && recoveryLevel) {
+        serial_log_printf(LOG_INFO, "[OBD] Recovered at %u", recoveryLevel);
+        recoveryLevel = 0;
+      }
+      if (obd.errors >= MAX_OBD_ERRORS) recoverOBD();
+#if DTC_SWEEP_INTERVAL
+      if (state.check(STATE_OBD_READY) && (!swept || millis() - lastSweep >= DTC_SWEEP_INTERVAL)) {
+        sweepDTC();
+        lastSweep = millis();
+        swept = true;
+      }
+#endif
+    } else if (millis() - lastInit >= 1000) {
+      lastInit = millis();
+      if (obd.init(PROTO_ISO15765_11B_500K, true)) {
+        responseCache.setIgnition(true);
+        state.set(STATE_OBD_READY);
+        serial_log_print(LOG_INFO, "[OBD] ECU ON");
+      } else {
+        serial_log_print(LOG_INFO, "[OBD] Init (fast) failed");
+      }
+    }
+    if (sys.devType <= 12 && millis() - lastVoltage >= 1000) {
+      lastVoltage = millis();
+      batteryVoltage = obd.getVoltage();
+    }
+    obdLock.unlock();
+    delay(OBD_TASK_INTERVAL);
+  }
 }
 #endif
 
@@ -594,11 +1069,13 @@ void initialize()
 
 #if ENABLE_OBD
   // initialize OBD communication
+  obdLock.lock();
   if (!state.check(STATE_OBD_READY)) {
     timeoutsOBD = 0;
     serial_log_print(LOG_INFO, "[OBD] Init: PROTO_ISO15765_11B_500K");
     if (obd.init(PROTO_ISO15765_11B_500K)) {
       serial_log_print(LOG_INFO, "OBD:OK");
+      responseCache.setIgnition(true);
       state.set(STATE_OBD_READY);
 #if ENABLE_OLED
       oled.println("OBD OK");
@@ -609,6 +1086,7 @@ void initialize()
       //return;
     }
   }
+  obdLock.unlock();
 #endif
 
 #if STORAGE != STORAGE_NONE
@@ -620,6 +1098,17 @@ void initialize()
   }
   if (state.check(STATE_STORAGE_READY)) {
     fileid = logger.begin();
+#if ENABLE_OBD && ENABLE_CAN_TRACE && STORAGE == STORAGE_SD
+    if (fileid) {
+      char path[24];
+      sprintf(path, "/DATA/%u.TRC", fileid);
+      traceFile = SD.open(path, FILE_WRITE);
+      obdLock.lock();
+      traceLink.attach(traceFile ? &traceFile : 0);
+      obdLock.unlock();
+      serial_log_printf(LOG_INFO, "[OBD] Trace: %s", traceFile ? path : "error");
+    }
+#endif
   }
 #endif
 
@@ -627,11 +1116,18 @@ void initialize()
 #if ENABLE_OBD
   if (state.check(STATE_OBD_READY)) {
     char buf[128];
+    obdLock.lock();
     if (obd.getVIN(buf, sizeof(buf))) {
       memcpy(vin, buf, sizeof(vin) - 1);
       serial_log_printf(LOG_INFO, "VIN:%s", vin);
+      if (!obd.checkWarmVIN(vin)) {
+        serial_log_print(LOG_INFO, "[OBD] Other vehicle, full init");
+        obd.init(PROTO_ISO15765_11B_500K);
+      }
     }
+    applySupportCache(vin);
     int dtcCount = obd.readDTC(dtc, sizeof(dtc) / sizeof(dtc[0]));
+    obdLock.unlock();
     if (dtcCount > 0) {
       serial_log_printf(LOG_INFO, "DTC:%d", dtcCount);
     }
@@ -666,7 +1162,7 @@ void initialize()
  * Logic: Calculates elapsed time and traffic rates, then prints counters and rates.
  * Inputs: none.
  * Outputs: none.
- * Notes: Uses teleClient counters and startTime.
+ * Notes: Uses teleClient counters and startTime; also reports live/backlog transmit counters.
  */
 void showStats()
 {
@@ -679,6 +1175,14 @@ void showStats()
     (unsigned long)(teleClient.txBytes >> 10),
     (unsigned long)teleClient.rxBytes,
     (unsigned int)((uint64_t)(teleClient.txBytes + teleClient.rxBytes) * 3600 / (millis() - teleClient.startTime)));
+  serial_log_printf(LOG_INFO, "[NET] Live: %lu | Backlog: %lu sent, %u queued, %lus old | Retried: %lu | Dropped: %lu | Oversize: %lu",
+    (unsigned long)txLive,
+    (unsigned long)txDrained,
+    (unsigned int)bufman.queued(),
+    (unsigned long)(backlogAge / 1000),
+    (unsigned long)txRestored,
+    (unsigned long)bufman.dropped(),
+    (unsigned long)txOversize);
 #if ENABLE_OLED
   oled.setCursor(0, 2);
   oled.println(timestr);
@@ -750,62 +1254,29 @@ bool waitMotion(long timeout)
  */
 void process()
 {
-  static uint32_t lastUdsRead = 0;
-  const uint32_t udsIntervalMs = 1000; // interval for UDS read test 1000 ms = 1 sec
-  static uint8_t udsIndex = 0;
   static uint32_t lastGPStick = 0;
   uint32_t startTime = millis();
 
-  CBuffer* buffer = bufman.getFree();
-  buffer->state = BUFFER_STATE_FILLING;
+  CBuffer* buffer = bufman.acquire();
 
 #if ENABLE_OBD
-  // process OBD data if connected
-  if (state.check(STATE_OBD_READY)) {
-    bool runUdsTest = (millis() - lastUdsRead >= udsIntervalMs);
-
-    // Avoid mixing periodic OBD polling (7DF/5xx) with UDS tests in the same loop iteration.
-    // This keeps the sniff trace cleaner and reduces the risk of stale responses remaining in the adapter RX buffer.
-    if (runUdsTest) {
-      String DID_reply;
-      struct UdsRequest {
-        uint16_t canId;
-        uint32_t did;
-      };
-      static const UdsRequest udsRequests[] = {
-        {0x7E4, 0x220101}, // BMS
-        {0x7E4, 0x220105}, // BMS
-        {0x744, 0x22E001}, // VCMS
-        {0x7A0, 0x22C000}, // BDC-TPMS
-        {0x7B3, 0x220100}, // AIRCON
-        {0x7C6, 0x22B002}, // CLUSTER
-        {0x7E2, 0x22E004}, // VCU
-      };
-
-      const UdsRequest& req = udsRequests[udsIndex];
-      if (readUDS_DID(req.canId, req.did, DID_reply)) {
-        serial_log_print(LOG_INFO, "UDS raw response:");
-        serial_log_print(LOG_INFO, DID_reply);
-      }
-      udsIndex = (udsIndex + 1) % (sizeof(udsRequests) / sizeof(udsRequests[0]));
-      
-      lastUdsRead = millis();
+  // take the samples the acquisition task collected since the last cycle
+  PollSample sample;
+  while (obdSamples.pop(sample)) {
+    buffer->add(sample.pid, ELEMENT_INT32, &sample.value, sizeof(sample.value));
+  }
+  if (!state.check(STATE_WORKING)) {
+    // the acquisition task found the ECU off; keep the last values and DTC changes it read
+    if (buffer->total) {
+      buffer->timestamp = millis();
+#if STORAGE != STORAGE_NONE
+      if (state.check(STATE_STORAGE_READY)) buffer->serialize(logger);
+#endif
+      bufman.commit(buffer);
     } else {
-      processOBD(buffer);
-    }
-    if (obd.errors >= MAX_OBD_ERRORS) {
-      serial_log_print(LOG_INFO, "[OBD] Re-init after errors");
-      if (!obd.init(PROTO_ISO15765_11B_500K)) {
-        serial_log_print(LOG_INFO, "[OBD] ECU OFF");
-        state.clear(STATE_OBD_READY | STATE_WORKING);
-        return;
-      }
+      bufman.free(buffer);
     }
-  } else if (obd.init(PROTO_ISO15765_11B_500K, true)) {
-    state.set(STATE_OBD_READY);
-    serial_log_print(LOG_INFO, "[OBD] ECU ON");
-  } else {
-    serial_log_print(LOG_INFO, "[OBD] Init (fast) failed");
+    return;
   }
 #endif
 
@@ -816,8 +1287,6 @@ void process()
 #if ENABLE_OBD
   if (sys.devType > 12) {
     batteryVoltage = (float)(analogRead(A0) * 45) / 4095;
-  } else {
-    batteryVoltage = obd.getVoltage();
   }
   if (batteryVoltage) {
     uint16_t v = batteryVoltage * 100;
@@ -855,25 +1324,32 @@ void process()
   buffer->add(PID_DEVICE_TEMP, ELEMENT_INT32, &deviceTemp, sizeof(deviceTemp));
 
   buffer->timestamp = millis();
-  buffer->state = BUFFER_STATE_FILLED;
-
-  // display file buffer stats
-  if (startTime - lastStatsTime >= 3000) {
-    bufman.printStats();
-    lastStatsTime = startTime;
-  }
 
 #if STORAGE != STORAGE_NONE
+  // logged before it is queued, since the telemetry task frees a buffer once it is sent
   if (state.check(STATE_STORAGE_READY)) {
     buffer->serialize(logger);
     uint16_t sizeKB = (uint16_t)(logger.size() >> 10);
     if (sizeKB != lastSizeKB) {
       logger.flush();
+#if ENABLE_OBD && ENABLE_CAN_TRACE && STORAGE == STORAGE_SD
+      obdLock.lock();
+      traceLink.flush();
+      traceFile.flush();
+      obdLock.unlock();
+#endif
       lastSizeKB = sizeKB;
       serial_log_printf(LOG_INFO, "[FILE] %uKB", sizeKB);
     }
   }
 #endif
+  bufman.commit(buffer);
+
+  // display file buffer stats
+  if (startTime - lastStatsTime >= 3000) {
+    bufman.printStats();
+    lastStatsTime = startTime;
+  }
 
   const int dataIntervals[] = DATA_INTERVAL_TABLE;
 #if ENABLE_OBD || ENABLE_MEMS
@@ -986,6 +1462,10 @@ bool initCell(bool quick = false)
 /*
  * Summary: Background task that manages network connectivity and data transmission.
  * Logic: Handles standby pinging, Wi-Fi/cellular setup, buffer transmission, and reconnection.
+ *        With TX_DUAL, a newly committed buffer is sent first (newest) and the backlog is drained
+ *        oldest-first behind it, packing as many buffers as fit in TX_PACKET_SIZE into one
+ *        packet; buffers that fail to send are put back at the oldest end. A buffer that does
+ *        not fit one packet on its own is dropped and counted instead of sent truncated.
  * Inputs: inst (unused task parameter).
  * Outputs: none.
  * Notes: Runs indefinitely as a FreeRTOS task.
@@ -994,6 +1474,9 @@ void telemetry(void* inst)
 {
   uint32_t lastRssiTime = 0;
   uint8_t connErrors = 0;
+#if TX_POLICY == TX_DUAL
+  uint32_t lastCommits = 0;
+#endif
   CStorageRAM store;
   store.init(
 #if BOARD_HAS_PSRAM
@@ -1118,7 +1601,16 @@ void telemetry(void* inst)
       }
 
       // get data from buffer
+#if TX_POLICY == TX_DUAL
+      // fresh data goes out first, the backlog drains oldest-first whenever nothing new is queued
+      uint32_t commits = bufman.commits();
+      bool live = commits != lastCommits;
+      lastCommits = commits;
+      CBuffer* buffer = live ? bufman.getNewest() : bufman.getOldest();
+#else
+      bool live = true;
       CBuffer* buffer = bufman.getNewest();
+#endif
       if (!buffer) {
         delay(50);
         continue;
@@ -1128,7 +1620,40 @@ void telemetry(void* inst)
 #endif
       store.timestamp(buffer->timestamp);
       buffer->serialize(store);
+      if (store.overflowed() || store.length() + 3 > TX_PACKET_SIZE) {
+        // BUFFER_LENGTH is sized for this not to happen; a truncated packet would only be
+        // rejected by the server, so the buffer is dropped and counted
+        txOversize++;
+        serial_log_printf(LOG_INFO, "[DAT] Buffer of %u samples exceeds %u bytes, dropped",
+          (unsigned int)buffer->total, (unsigned int)TX_PACKET_SIZE);
+        bufman.free(buffer);
+        store.purge();
+        continue;
+      }
+#if TX_POLICY == TX_DUAL
+      // fill the rest of the packet with the backlog, oldest first; every buffer carries its own
+      // timestamp while header and checksum are shared, so a deep backlog goes out in few packets
+      CBuffer* packed[TX_BATCH_MAX];
+      uint8_t count = 0;
+      packed[count++] = buffer;
+      while (count < TX_BATCH_MAX) {
+        unsigned int length = store.length();
+        uint16_t samples = store.samples();
+        CBuffer* next = bufman.getOldest();
+        if (!next) break;
+        store.timestamp(next->timestamp);
+        next->serialize(store);
+        if (store.overflowed() || store.length() + 3 > TX_PACKET_SIZE) {
+          // does not fit, goes first into the next packet
+          store.rewind(length, samples);
+          bufman.restore(next);
+          break;
+        }
+        packed[count++] = next;
+      }
+#else
       bufman.free(buffer);
+#endif
       store.tailer();
       serial_log_print(LOG_INFO, String("[DAT] ") + store.buffer());
 
@@ -1140,8 +1665,31 @@ void telemetry(void* inst)
       if (teleClient.transmit(store.buffer(), store.length())) {
         // successfully sent
         connErrors = 0;
+        if (live) {
+          txLive++;
+        }
+#if TX_POLICY == TX_DUAL
+        if (count > (live ? 1 : 0)) {
+          txDrained += count - (live ? 1 : 0);
+          backlogAge = millis() - packed[count - 1]->timestamp;
+        } else if (!bufman.queued()) {
+          backlogAge = 0;
+        }
+        for (uint8_t n = 0; n < count; n++) bufman.free(packed[n]);
+#endif
         showStats();
       } else {
+#if TX_POLICY == TX_DUAL
+        // keep the data; restoring the backlog in reverse puts it back at the oldest end in its
+        // original order, the live buffer goes back to the newest end
+        for (uint8_t n = count; n > 1; n--) bufman.restore(packed[n - 1]);
+        if (live) {
+          bufman.restoreNewest(packed[0]);
+        } else {
+          bufman.restore(packed[0]);
+        }
+        txRestored += count;
+#endif
         timeoutsNet++;
         connErrors++;
         printTimeoutStats();
@@ -1212,6 +1760,12 @@ void standby()
 #if STORAGE != STORAGE_NONE
   if (state.check(STATE_STORAGE_READY)) {
     logger.end();
+#if ENABLE_OBD && ENABLE_CAN_TRACE && STORAGE == STORAGE_SD
+    obdLock.lock();
+    traceLink.attach(0);
+    obdLock.unlock();
+    traceFile.close();
+#endif
   }
 #endif
 
@@ -1225,6 +1779,7 @@ void standby()
 #endif
 
   state.clear(STATE_WORKING | STATE_OBD_READY | STATE_STORAGE_READY);
+  responseCache.setIgnition(false);
   // this will put co-processor into sleep mode
 #if ENABLE_OLED
   oled.print("STANDBY");
@@ -1232,7 +1787,14 @@ void standby()
   oled.clear();
 #endif
   serial_log_print(LOG_INFO, "ENTERING STANDBY MODE - LOW POWER AND WAITING FOR WAKEUP");
+#if ENABLE_OBD
+  // waits for the acquisition task to finish its cycle; it stays idle while STATE_STANDBY is set
+  obdLock.lock();
+  obd.enterLowPowerMode();
+  obdLock.unlock();
+#else
   obd.enterLowPowerMode();
+#endif
 #if ENABLE_MEMS
   calibrateMEMS();
   waitMotion(-1);
@@ -1244,6 +1806,11 @@ void standby()
   delay(5000);
 #endif
   serial_log_print(LOG_INFO, "WAKEUP FROM STANDBY");
+#if ENABLE_OBD && OBD_WARM_START
+  // an adapter that answers keeps its state for the warm start; only hard reset a silent one
+  char buf[32];
+  if (obdWarm.magic != OBD_WARM_MAGIC || !sys.link || !sys.link->sendCommand("ATI\r", buf, sizeof(buf), 1000))
+#endif
   sys.resetLink();
 #if RESET_AFTER_WAKEUP
 #if ENABLE_MEMS
@@ -1431,6 +1998,24 @@ void loadSdIniOverrides()
   };
   bool abrpLoaded = loadIniFile("/cfg/abrp.ini", abrpEntries, sizeof(abrpEntries) / sizeof(abrpEntries[0]));
   logIniEntries("/cfg/abrp.ini", abrpEntries, sizeof(abrpEntries) / sizeof(abrpEntries[0]), abrpLoaded);
+
+#if ENABLE_OBD
+  // per-request poll periods, keyed by the pollTable entry name
+  const size_t pollCount = sizeof(pollTable) / sizeof(pollTable[0]);
+  char pollValues[pollCount][12];
+  IniEntry pollEntries[pollCount];
+  for (size_t i = 0; i < pollCount; i++) {
+    pollValues[i][0] = 0;
+    pollEntries[i] = {pollTable[i].name, pollValues[i], sizeof(pollValues[i]), false};
+  }
+  if (loadIniFile("/cfg/poll.ini", pollEntries, pollCount)) {
+    for (size_t i = 0; i < pollCount; i++) {
+      if (pollEntries[i].found && poller.setPeriod(pollEntries[i].key, atol(pollValues[i]))) {
+        serial_log_printf(LOG_INFO, "[INI] poll %s period: %sms", pollEntries[i].key, pollValues[i]);
+      }
+    }
+  }
+#endif
 }
 #endif
 
@@ -1544,22 +2129,35 @@ void processBLE(int timeout)
 #endif
       );
   } else if (!memcmp(cmd, "01", 2)) {
+    // served from the response cache; only a missing or expired value is read from the bus
     byte pid = hex2uint8(cmd + 2);
-    for (byte i = 0; i < sizeof(obdData) / sizeof(obdData[0]); i++) {
-      if (obdData[i].pid == pid) {
-        n += snprintf(buf + n, bufsize - n, "%d", obdData[i].value);
-        pid = 0;
-        break;
-      }
-    }
-    if (pid) {
+    static CacheReply reply;
+    if (responseCache.get(POLL_OBD_PID, 0, pid, millis(), reply)) {
+      n += snprintf(buf + n, bufsize - n, "%d", (int)reply.value);
+    } else {
       int value;
-      if (obd.readPID(pid, value)) {
+#if ENABLE_OBD
+      obdLock.lock();
+#endif
+      bool ok = obd.readPID(pid, value);
+      if (ok) responseCache.put(POLL_OBD_PID, 0, pid, value, 0, 0, CACHE_DEFAULT_TTL, 0, millis());
+#if ENABLE_OBD
+      obdLock.unlock();
+#endif
+      if (ok) {
         n += snprintf(buf + n, bufsize - n, "%d", value);
       } else {
         n += snprintf(buf + n, bufsize - n, "N/A");
       }
     }
+  } else if (!strcmp(cmd, "TMO")) {
+    // learned response timeouts as <CAN ID>/<service>:<ms>
+    byte count;
+    const OBD_LATENCY* stats = obd.getLatencyStats(count);
+    for (byte i = 0; i < count && n < bufsize - 16; i++) {
+      n += snprintf(buf + n, bufsize - n, "%s%X/%02X:%u", i ? " " : "", (unsigned int)stats[i].canId, stats[i].service, stats[i].timeout);
+    }
+    if (!count) n += snprintf(buf + n, bufsize - n, "N/A");
   } else if (!strcmp(cmd, "VIN")) {
     n += snprintf(buf + n, bufsize - n, "%s", vin[0] ? vin : "N/A");
   } else if (!strcmp(cmd, "LAT") && gd) {
@@ -1611,8 +2209,15 @@ void setup()
   }
   ESP_ERROR_CHECK( err );
   err = nvs_open("storage", NVS_READWRITE, &nvs);
+#if ENABLE_OBD
+  uint32_t linkBaud = 0;
+#endif
   if (err == ESP_OK) {
     loadConfig();
+#if ENABLE_OBD
+    loadSupportCache();
+    nvs_get_u32(nvs, "LINK_BAUD", &linkBaud);
+#endif
   }
 
 #if ENABLE_OLED
@@ -1622,6 +2227,15 @@ void setup()
   // initialize USB serial
   Serial.begin(115200);
 
+#if ENABLE_OBD
+  poller.begin(pollTable, sizeof(pollTable) / sizeof(pollTable[0]), millis());
+#if DTC_SWEEP_INTERVAL
+  for (size_t i = 0; i < sizeof(pollTable) / sizeof(pollTable[0]); i++) {
+    if (pollTable[i].kind == POLL_UDS_DID) dtcSweep.addEcu(pollTable[i].canId);
+  }
+#endif
+#endif
+
 #if STORAGE == STORAGE_SD
   loadSdIniOverrides();
 #endif
@@ -1657,9 +2271,20 @@ void setup()
   //serial_log_print(LOG_INFO, "KB");
 
 #if ENABLE_OBD
-  if (sys.begin()) {
+  if (sys.begin(true, true, linkBaud ? linkBaud : LINK_UART_BAUDRATE)) {
     serial_log_printf(LOG_INFO, "TYPE:%d", sys.devType);
+#if LINK_UART_NEGOTIATE
+    negotiateLinkBaudRate(linkBaud);
+#endif
+#if OBD_WARM_START
+    obd.setWarmState(&obdWarm);
+#endif
+#if ENABLE_CAN_TRACE && STORAGE == STORAGE_SD
+    traceLink.wrap(sys.link);
+    obd.begin(&traceLink);
+#else
     obd.begin(sys.link);
+#endif
   } else {
     serial_log_print(LOG_INFO, "[OBD] sys.begin() failed; OBD link not initialized");
   }
@@ -1724,6 +2349,10 @@ if (!state.check(STATE_MEMS_READY)) do {
 
   // initialize network and maintain connection
   subtask.create(telemetry, "telemetry", 2, 8192);
+#if ENABLE_OBD
+  // OBD/CAN acquisition, pinned away from the network stack
+  obdTask.create(obdAcquisition, "obd", 3, 8192, OBD_TASK_CORE);
+#endif
 
 #ifdef PIN_LED
   digitalWrite(PIN_LED, LOW);
@@ -91,6 +91,7 @@ void CStorageRAM::dispatch(const char* buf, byte len)
     int remain = m_cacheSize - m_cacheBytes - len - 3;
     if (remain < 0) {
         // m_cache full
+        m_overflowed = true;
         return;
     }
     // store data in m_cache
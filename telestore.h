@@ -41,8 +41,17 @@ public:
             m_cacheSize = 0;
         }
     }
-    void purge() { m_cacheBytes = 0; m_samples = 0; }
+    void purge() { m_cacheBytes = 0; m_samples = 0; m_overflowed = false; }
     unsigned int length() { return m_cacheBytes; }
+    // true if data was discarded since purge() because the cache was full
+    bool overflowed() { return m_overflowed; }
+    // rolls back to an earlier length() and samples(), e.g. to drop data that did not fit
+    void rewind(unsigned int bytes, uint16_t samples)
+    {
+        m_cacheBytes = bytes;
+        m_samples = samples;
+        m_overflowed = false;
+    }
     char* buffer() { return m_cache; }
     void dispatch(const char* buf, byte len);
     void header(const char* devid);
@@ -52,6 +61,7 @@ protected:
     unsigned int m_cacheSize = 0;
     unsigned int m_cacheBytes = 0;
     char* m_cache = 0;
+    bool m_overflowed = false;
 };
 
 class FileLogger : public CStorage {
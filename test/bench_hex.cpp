@@ -0,0 +1,159 @@
+/*************************************************************************
+* Hex decoding (FreematicsHex.cpp): equivalence with the previous branchy
+* parsers on random text, and a benchmark on a 62-byte BMS reply line
+*
+*   bench_hex [rounds]
+*************************************************************************/
+
+#include <chrono>
+#include <ctype.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "FreematicsHex.h"
+#include "check.h"
+
+// previous hex2uint8 from FreematicsOBD.cpp
+static uint8_t oldHex2uint8(const char* p)
+{
+  uint8_t c1 = *p;
+  uint8_t c2 = *(p + 1);
+  if (c1 >= 'A' && c1 <= 'F')
+    c1 -= 7;
+  else if (c1 >= 'a' && c1 <= 'f')
+    c1 -= 39;
+  else if (c1 < '0' || c1 > '9')
+    return 0;
+
+  if (c2 == 0)
+    return (c1 & 0xf);
+  else if (c2 >= 'A' && c2 <= 'F')
+    c2 -= 7;
+  else if (c2 >= 'a' && c2 <= 'f')
+    c2 -= 39;
+  else if (c2 < '0' || c2 > '9')
+    return 0;
+
+  return c1 << 4 | (c2 & 0xf);
+}
+
+// previous hex2uint16 from FreematicsOBD.cpp
+static uint16_t oldHex2uint16(const char* p)
+{
+  char c = *p;
+  uint16_t i = 0;
+  for (uint8_t n = 0; c && n < 4; c = *(++p)) {
+    if (c >= 'A' && c <= 'F') {
+      c -= 7;
+    } else if (c >= 'a' && c <= 'f') {
+      c -= 39;
+    } else if (c == ' ' && n == 2) {
+      continue;
+    } else if (c < '0' || c > '9') {
+      break;
+    }
+    i = (i << 4) | (c & 0xF);
+    n++;
+  }
+  return i;
+}
+
+// per-byte loop the call sites used before decodeHexBytes(), in its strict form
+static int oldDecodeLine(const char* p, const char* end, uint8_t* out, int outSize)
+{
+  int n = 0;
+  while (p < end) {
+    if (*p == ' ' || *p == ',') {
+      p++;
+      continue;
+    }
+    if (p + 1 >= end || !isxdigit((uint8_t)p[0]) || !isxdigit((uint8_t)p[1]) || n >= outSize) return -1;
+    out[n++] = oldHex2uint8(p);
+    p += 2;
+  }
+  return n;
+}
+
+typedef std::chrono::steady_clock clock_type;
+
+static double nsPer(clock_type::time_point start, clock_type::time_point end, long count)
+{
+  return std::chrono::duration<double, std::nano>(end - start).count() / count;
+}
+
+int main(int argc, char** argv)
+{
+  long rounds = argc > 1 ? atol(argv[1]) : 1000000;
+
+  // random text: mostly "AA BB" runs, salted with other characters
+  static const char alphabet[] = "0123456789ABCDEFabcdef  ,\r:Gz\x10\x19";
+  srand(1);
+  for (long it = 0; it < rounds / 4; it++) {
+    char s[40];
+    int len = rand() % 36;
+    for (int i = 0; i < len; i++) {
+      if (rand() % 4 == 0) {
+        s[i] = alphabet[rand() % (sizeof(alphabet) - 1)];
+      } else {
+        s[i] = (i % 3 == 2) ? ' ' : "0123456789ABCDEF"[rand() % 16];
+      }
+    }
+    s[len] = 0;
+    CHECK_EQ(hex2uint8(s), oldHex2uint8(s));
+    CHECK_EQ(hex2uint16(s), oldHex2uint16(s));
+    uint8_t a[16], b[16];
+    int size = rand() % 17;
+    int x = oldDecodeLine(s, s + len, a, size);
+    int y = decodeHexBytes(s, s + len, b, size);
+    CHECK_EQ(y, x);
+    if (x > 0 && x == y) CHECK(!memcmp(a, b, x));
+    if (checkFailures) {
+      printf("input \"%s\", size %d\n", s, size);
+      break;
+    }
+  }
+
+  // decoding in place, as readUDS_DID does
+  {
+    char text[] = "62 01 01 ff f7 e7";
+    CHECK_EQ(decodeHexBytes(text, text + strlen(text), (uint8_t*)text, sizeof(text)), 6);
+    CHECK(!memcmp(text, "\x62\x01\x01\xff\xf7\xe7", 6));
+  }
+  // lenient mode stops at the first non-pair and reports where
+  {
+    const char* text = "41 0C 1A F8\r41 0D";
+    const char* stop = 0;
+    uint8_t out[8];
+    CHECK_EQ(decodeHexBytes(text, text + strlen(text), out, sizeof(out), &stop), 4);
+    CHECK(stop == text + 11);
+    CHECK_EQ(decodeHexBytes(text, text + strlen(text), out, sizeof(out)), -1);
+  }
+
+  char line[200];
+  int len = 0;
+  for (int i = 0; i < 62; i++) len += sprintf(line + len, "%02X ", (i * 37) & 0xff);
+  line[--len] = 0;
+  uint8_t out[64];
+  volatile long sink = 0;
+
+  clock_type::time_point t0 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += oldDecodeLine(line, line + len, out, sizeof(out));
+  clock_type::time_point t1 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += decodeHexBytes(line, line + len, out, sizeof(out));
+  clock_type::time_point t2 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += oldHex2uint8(line + (k & 63) * 3);
+  clock_type::time_point t3 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += hex2uint8(line + (k & 63) * 3);
+  clock_type::time_point t4 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += oldHex2uint16(line + (k & 31) * 3);
+  clock_type::time_point t5 = clock_type::now();
+  for (long k = 0; k < rounds; k++) sink += hex2uint16(line + (k & 31) * 3);
+  clock_type::time_point t6 = clock_type::now();
+  (void)sink;
+
+  printf("62-byte line: per-byte loop %.1f ns, decodeHexBytes %.1f ns\n", nsPer(t0, t1, rounds), nsPer(t1, t2, rounds));
+  printf("hex2uint8: previous %.2f ns, table %.2f ns\n", nsPer(t2, t3, rounds), nsPer(t3, t4, rounds));
+  printf("hex2uint16: previous %.2f ns, table %.2f ns\n", nsPer(t4, t5, rounds), nsPer(t5, t6, rounds));
+  return checkResult("bench_hex");
+}
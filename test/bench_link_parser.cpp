@@ -0,0 +1,200 @@
+/*************************************************************************
+* Adapter reply scanning: CLinkParser/CLineIterator checks and a
+* microbenchmark against the previous strstr-based receive loop
+*************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include "FreematicsBase.h"
+#include "FreematicsOBD.h"
+#include "check.h"
+
+// bytes handed out per simulated uart_read_bytes() call
+#define CHUNK_SIZE 16
+
+// builds a multi-frame UDS reply of at least minLen characters, ending in the prompt
+static std::string makeReply(int minLen)
+{
+  std::string s = "7EC10 ";
+  char line[64];
+  for (int frame = 0; (int)s.size() < minLen; frame++) {
+    snprintf(line, sizeof(line), "7EC2%X %02X %02X %02X %02X %02X %02X %02X\r",
+      frame & 0xf, frame, frame + 1, frame + 2, frame + 3, frame + 4, frame + 5, frame + 6);
+    s += line;
+  }
+  return s + "\r>";
+}
+
+typedef const char* (*FindFunc)(const char* haystack, const char* needle);
+
+static const char* findLibc(const char* haystack, const char* needle)
+{
+  return strstr(haystack, needle);
+}
+
+// byte-at-a-time search as in the newlib strstr linked into the firmware; the host
+// libc version is vectorized and hides the cost of rescanning
+static const char* findBytewise(const char* haystack, const char* needle)
+{
+  for (; *haystack; haystack++) {
+    const char* h = haystack;
+    const char* n = needle;
+    while (*n && *h == *n) {
+      h++;
+      n++;
+    }
+    if (!*n) return haystack;
+  }
+  return 0;
+}
+
+// previous CLink_UART::receive body: rescans the accumulated buffer for "..." after every chunk
+static int receiveStrstr(FindFunc find, const std::string& reply, char* buffer, int bufsize)
+{
+  int n = 0;
+  size_t offset = 0;
+  for (;;) {
+    if (n >= bufsize - 1) break;
+    int len = reply.size() - offset;
+    if (len > CHUNK_SIZE) len = CHUNK_SIZE;
+    if (len > bufsize - n - 1) len = bufsize - n - 1;
+    if (len == 0) break;
+    memcpy(buffer + n, reply.data() + offset, len);
+    offset += len;
+    buffer[n + len] = 0;
+    if (find(buffer + n, "\r>")) {
+      n = n + len - 1;
+      buffer[n] = 0;
+      break;
+    }
+    n += len;
+    if (find(buffer, "...")) {
+      buffer[0] = 0;
+      n = 0;
+    }
+  }
+  return n;
+}
+
+// current CLink_UART::receive body: feeds each new byte to CLinkParser once
+static int receiveParser(CLinkParser& rx, const std::string& reply, char* buffer, int bufsize)
+{
+  int n = 0;
+  size_t offset = 0;
+  rx.reset();
+  buffer[0] = 0;
+  for (;;) {
+    if (n >= bufsize - 1) break;
+    int len = reply.size() - offset;
+    if (len > CHUNK_SIZE) len = CHUNK_SIZE;
+    if (len > bufsize - n - 1) len = bufsize - n - 1;
+    if (len == 0) break;
+    memcpy(buffer + n, reply.data() + offset, len);
+    offset += len;
+    bool prompt = false;
+    int end = n + len;
+    for (int pos = n; pos < end; pos++) {
+      if (rx.feed(buffer[pos])) {
+        end = pos;
+        prompt = true;
+        break;
+      }
+      if (rx.searching()) {
+        end -= pos + 1;
+        memmove(buffer, buffer + pos + 1, end);
+        pos = -1;
+      }
+    }
+    n = end;
+    buffer[n] = 0;
+    if (prompt) break;
+  }
+  return n;
+}
+
+static void checkParser()
+{
+  CLinkParser rx;
+  const char* s = "SEARCHING...\r41 0C 1A F8\r\rNO DATA\r\r>";
+  int prompts = 0, searches = 0, promptAt = -1;
+  rx.reset();
+  for (const char* c = s; *c; c++) {
+    if (rx.feed(*c)) {
+      prompts++;
+      promptAt = c - s;
+    }
+    if (rx.searching()) searches++;
+  }
+  CHECK_EQ(prompts, 1);
+  CHECK_EQ(promptAt, (int)strlen(s) - 1);
+  CHECK_EQ(searches, 1);
+  CHECK_EQ(rx.error(), 4);
+
+  // a mismatch restarts the token match on the current character
+  rx.reset();
+  for (const char* c = "EERROR"; *c; c++) rx.feed(*c);
+  CHECK_EQ(rx.error(), 2);
+  rx.reset();
+  for (const char* c = "41 0C 1A F8\r>"; *c; c++) rx.feed(*c);
+  CHECK_EQ(rx.error(), 0);
+
+  // text after SEARCHING... in the same chunk is kept
+  char buffer[128];
+  CHECK_EQ(receiveParser(rx, "SEARCHING...\r41 0D 32\r\r>", buffer, sizeof(buffer)), 11);
+  CHECK(!strcmp(buffer, "\r41 0D 32\r\r"));
+
+  CLineIterator lines(s, strlen(s));
+  const char* line;
+  int len;
+  CHECK(lines.next(line, len) && len == 12 && !strncmp(line, "SEARCHING...", len));
+  CHECK(lines.next(line, len) && len == 11 && !strncmp(line, "41 0C 1A F8", len));
+  CHECK(lines.next(line, len) && len == 7 && !strncmp(line, "NO DATA", len));
+  CHECK(lines.next(line, len) && len == 1 && *line == '>');
+  CHECK(!lines.next(line, len));
+}
+
+int main(int argc, char** argv)
+{
+  int rounds = argc > 1 ? atoi(argv[1]) : 2000;
+  checkParser();
+
+  std::string reply = makeReply(1024);
+  static char a[2048], b[2048];
+  CLinkParser rx;
+  int lenA = receiveStrstr(findLibc, reply, a, sizeof(a));
+  int lenB = receiveParser(rx, reply, b, sizeof(b));
+  CHECK_EQ(lenA, lenB);
+  CHECK_EQ(lenA, (int)reply.size() - 1);
+  CHECK(!memcmp(a, b, lenA));
+  CHECK_EQ(receiveStrstr(findBytewise, reply, a, sizeof(a)), lenA);
+  CHECK(!memcmp(a, b, lenA));
+
+  CLineIterator lines(b, lenB);
+  const char* line;
+  int len, count = 0;
+  while (lines.next(line, len)) count++;
+  CHECK_EQ(count, std::count(reply.begin(), reply.end(), '\r') - 1);
+
+  typedef std::chrono::steady_clock clock;
+  long long total = 0;
+  clock::time_point t0 = clock::now();
+  for (int i = 0; i < rounds; i++) total += receiveStrstr(findLibc, reply, a, sizeof(a));
+  clock::time_point t1 = clock::now();
+  for (int i = 0; i < rounds; i++) total += receiveStrstr(findBytewise, reply, a, sizeof(a));
+  clock::time_point t2 = clock::now();
+  for (int i = 0; i < rounds; i++) total += receiveParser(rx, reply, b, sizeof(b));
+  clock::time_point t3 = clock::now();
+  CHECK_EQ(total, 3LL * rounds * lenA);
+
+  double libcNs = std::chrono::duration<double, std::nano>(t1 - t0).count() / rounds;
+  double bytewiseNs = std::chrono::duration<double, std::nano>(t2 - t1).count() / rounds;
+  double parserNs = std::chrono::duration<double, std::nano>(t3 - t2).count() / rounds;
+  printf("%d-byte reply in %d-byte chunks, per reply:\n", lenA, CHUNK_SIZE);
+  printf("  strstr rescan (host libc)  %8.0f ns\n", libcNs);
+  printf("  strstr rescan (byte-wise)  %8.0f ns\n", bytewiseNs);
+  printf("  CLinkParser                %8.0f ns (%.1fx byte-wise)\n", parserNs, bytewiseNs / parserNs);
+  return checkResult("bench_link_parser");
+}
@@ -0,0 +1,35 @@
+/*************************************************************************
+* Minimal assertion helpers for the host tests
+*************************************************************************/
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <stdio.h>
+
+static int checkFailures = 0;
+
+// records a failure and keeps going, so one run reports every broken expectation
+#define CHECK(cond) do { \
+  if (!(cond)) { \
+    printf("%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #cond); \
+    checkFailures++; \
+  } \
+} while (0)
+
+#define CHECK_EQ(a, b) do { \
+  long long va_ = (long long)(a), vb_ = (long long)(b); \
+  if (va_ != vb_) { \
+    printf("%s:%d: CHECK_EQ(%s, %s) failed: %lld != %lld\n", __FILE__, __LINE__, #a, #b, va_, vb_); \
+    checkFailures++; \
+  } \
+} while (0)
+
+// exit code for main()
+static inline int checkResult(const char* name)
+{
+  printf("%s: %s\n", name, checkFailures ? "FAILED" : "passed");
+  return checkFailures ? 1 : 0;
+}
+
+#endif
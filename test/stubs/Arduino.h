@@ -0,0 +1,76 @@
+/*************************************************************************
+* Minimal Arduino core for building firmware modules on a Linux host
+*************************************************************************/
+
+#ifndef HOST_ARDUINO_H
+#define HOST_ARDUINO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include <string>
+
+typedef uint8_t byte;
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+class String {
+public:
+  String() {}
+  String(const char* s) : m_s(s ? s : "") {}
+  String(int v) : m_s(std::to_string(v)) {}
+  String(unsigned int v) : m_s(std::to_string(v)) {}
+  String(long v) : m_s(std::to_string(v)) {}
+  String(unsigned long v) : m_s(std::to_string(v)) {}
+  const char* c_str() const { return m_s.c_str(); }
+  unsigned int length() const { return m_s.size(); }
+  String& operator+=(const String& s) { m_s += s.m_s; return *this; }
+  String operator+(const String& s) const { String r(*this); r += s; return r; }
+private:
+  std::string m_s;
+};
+
+class Print {
+public:
+  virtual ~Print() {}
+  virtual size_t write(uint8_t c) = 0;
+  virtual size_t write(const uint8_t* buf, size_t len)
+  {
+    size_t n = 0;
+    while (len--) n += write(*buf++);
+    return n;
+  }
+  size_t print(const char* s) { return write((const uint8_t*)s, strlen(s)); }
+  size_t print(const String& s) { return print(s.c_str()); }
+  size_t print(int v) { return print(String(v)); }
+  size_t print(unsigned int v) { return print(String(v)); }
+  size_t print(long v) { return print(String(v)); }
+  size_t print(unsigned long v) { return print(String(v)); }
+  size_t print(char c) { return write((uint8_t)c); }
+  template<class T> size_t println(const T& v) { return print(v) + print("\n"); }
+  size_t println() { return print("\n"); }
+};
+
+class Stream : public Print {
+public:
+  virtual int available() { return 0; }
+  virtual int read() { return -1; }
+};
+
+// console output goes to stdout
+class HardwareSerial : public Stream {
+public:
+  void begin(unsigned long) {}
+  size_t write(uint8_t c) { return fputc(c, stdout) == EOF ? 0 : 1; }
+  using Print::write;
+};
+
+extern HardwareSerial Serial;
+
+#endif
@@ -0,0 +1,59 @@
+/*************************************************************************
+* Host stand-in for the ESP32 FS, SD and SPIFFS libraries: no file system,
+* every open fails, so the storage classes build and report "no card"
+*************************************************************************/
+
+#ifndef HOST_FS_H
+#define HOST_FS_H
+
+#include <Arduino.h>
+
+#define FILE_READ "r"
+#define FILE_WRITE "w"
+#define FILE_APPEND "a"
+
+class File : public Stream {
+public:
+  size_t write(uint8_t c) { return 0; }
+  using Print::write;
+  void flush() {}
+  void close() {}
+  // non-const, as newlib's strrchr() takes a const char* and still returns char*
+  char* name()
+  {
+    static char none[1];
+    return none;
+  }
+  File openNextFile() { return File(); }
+  operator bool() const { return false; }
+};
+
+class FSClass {
+public:
+  File open(const char* path, const char* mode = FILE_READ) { return File(); }
+  bool mkdir(const char* path) { return false; }
+  bool remove(const char* path) { return false; }
+  size_t totalBytes() { return 0; }
+  size_t usedBytes() { return 0; }
+};
+
+class SPIClass {
+public:
+  void begin() {}
+};
+
+class SDFS : public FSClass {
+public:
+  bool begin(uint8_t ssPin, SPIClass& spi, uint32_t frequency) { return false; }
+};
+
+class SPIFFSFS : public FSClass {
+public:
+  bool begin(bool formatOnFail = false) { return false; }
+};
+
+extern SPIClass SPI;
+extern SDFS SD;
+extern SPIFFSFS SPIFFS;
+
+#endif
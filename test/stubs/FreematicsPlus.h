@@ -0,0 +1,17 @@
+/*************************************************************************
+* Host stand-in for FreematicsPlus.h: only the hardware-independent parts
+* of the library (no UART/SPI links, no ESP32 peripherals)
+*************************************************************************/
+
+#ifndef FREEMATICS_PLUS
+#define FREEMATICS_PLUS
+
+#include "FreematicsBase.h"
+#include "FreematicsOBD.h"
+#include "FreematicsTrace.h"
+
+// SD card wiring referred to by telestore.cpp
+#define PIN_SD_CS 5
+#define SPI_FREQ 1000000
+
+#endif
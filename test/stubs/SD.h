@@ -0,0 +1,2 @@
+// host stand-in, see FS.h
+#include "FS.h"
@@ -0,0 +1,35 @@
+/*************************************************************************
+* Host implementation of the Arduino core functions used by the tests
+*************************************************************************/
+
+#include <chrono>
+#include <thread>
+#include "Arduino.h"
+#include "FS.h"
+
+HardwareSerial Serial;
+SPIClass SPI;
+SDFS SD;
+SPIFFSFS SPIFFS;
+
+static const std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+unsigned long millis()
+{
+  return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+unsigned long micros()
+{
+  return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - startTime).count();
+}
+
+void delay(unsigned long ms)
+{
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  std::this_thread::sleep_for(std::chrono::microseconds(us));
+}
@@ -0,0 +1,198 @@
+/*************************************************************************
+* CBufferManager queue (telebuffer.cpp): ordering, restore, arena overwrite,
+* and a two-thread producer/consumer stress run
+*
+*   test_buffer_ring [buffers]
+*************************************************************************/
+
+#include <atomic>
+#include <stdlib.h>
+#include <thread>
+#include <vector>
+#include "telebuffer.h"
+#include "check.h"
+
+static CBufferManager bufman;
+
+// payload bytes of buffer number seq, so the consumer can tell buffers apart by size too
+static int payloadBytes(uint32_t seq)
+{
+  return 8 + (seq * 37) % 200;
+}
+
+// fills and queues buffer number seq
+static void produce(uint32_t seq)
+{
+  static uint8_t payload[256];
+  CBuffer* buffer = bufman.acquire();
+  CHECK_EQ(buffer->state.load(), BUFFER_STATE_FILLING);
+  buffer->timestamp = seq;
+  buffer->add(0x100, ELEMENT_UINT8, payload, payloadBytes(seq), payloadBytes(seq));
+  bufman.commit(buffer);
+}
+
+// checks a taken buffer and returns its number
+static uint32_t inspect(CBuffer* buffer)
+{
+  CHECK_EQ(buffer->state.load(), BUFFER_STATE_LOCKED);
+  CHECK_EQ(buffer->total, 1);
+  CHECK_EQ(buffer->offset, sizeof(ELEMENT_HEAD) + payloadBytes(buffer->timestamp));
+  return buffer->timestamp;
+}
+
+static void checkSingleThread()
+{
+  bufman.init();
+  CHECK(bufman.getOldest() == 0 && bufman.getNewest() == 0);
+  for (uint32_t seq = 1; seq <= 5; seq++) produce(seq);
+  CHECK_EQ(bufman.queued(), 5);
+  CHECK_EQ(bufman.commits(), 5);
+
+  // both ends, and a failed send restored to either end
+  CBuffer* oldest = bufman.getOldest();
+  CHECK_EQ(inspect(oldest), 1);
+  CBuffer* newest = bufman.getNewest();
+  CHECK_EQ(inspect(newest), 5);
+  bufman.restore(oldest);
+  CHECK_EQ(bufman.queued(), 4);
+  CHECK_EQ(inspect(bufman.getOldest()), 1);
+  bufman.free(oldest);
+  // a restored newest buffer waits for the producer and is queued ahead of its next commit
+  bufman.restoreNewest(newest);
+  CHECK_EQ(bufman.queued(), 3);
+  produce(6);
+  CHECK_EQ(bufman.queued(), 5);
+  std::vector<uint32_t> order;
+  for (CBuffer* buffer; (buffer = bufman.getOldest()); bufman.free(buffer)) order.push_back(inspect(buffer));
+  CHECK(order == std::vector<uint32_t>({2, 3, 4, 5, 6}));
+  // ... and behind the buffers committed while it was out
+  for (uint32_t seq = 1; seq <= 3; seq++) produce(seq);
+  newest = bufman.getNewest();
+  produce(4);
+  bufman.restoreNewest(newest);
+  produce(5);
+  order.clear();
+  for (CBuffer* buffer; (buffer = bufman.getOldest()); bufman.free(buffer)) order.push_back(inspect(buffer));
+  CHECK(order == std::vector<uint32_t>({1, 2, 4, 3, 5}));
+
+  // purge drops the queue and a pending hand-over alike
+  produce(7);
+  produce(8);
+  bufman.restoreNewest(bufman.getNewest());
+  bufman.purge();
+  CHECK_EQ(bufman.queued(), 0);
+  produce(9);
+  CHECK_EQ(bufman.queued(), 1);
+  CBuffer* buffer = bufman.getOldest();
+  CHECK_EQ(inspect(buffer), 9);
+  bufman.free(buffer);
+
+  // a full arena overwrites the oldest buffers and counts them
+  uint32_t dropped = bufman.dropped();
+  int count = BUFFER_ARENA_SIZE / 64;
+  for (int n = 0; n < count; n++) produce(100 + n);
+  CHECK(bufman.dropped() > dropped);
+  CHECK_EQ(bufman.queued() + (bufman.dropped() - dropped), count);
+  uint32_t last = 0;
+  for (CBuffer* buffer; (buffer = bufman.getOldest()); bufman.free(buffer)) {
+    uint32_t seq = inspect(buffer);
+    CHECK(seq > last);
+    last = seq;
+  }
+  CHECK_EQ(last, 100 + count - 1);
+
+  // the buffer being sent is never overwritten; the new one is discarded instead
+  for (int n = 0; n < count; n++) produce(1000 + n);
+  CBuffer* sending = bufman.getOldest();
+  uint32_t seq = inspect(sending);
+  dropped = bufman.dropped();
+  for (int n = 0; n < count; n++) produce(2000 + n);
+  CHECK(bufman.dropped() > dropped);
+  CHECK_EQ(inspect(sending), seq);
+  bufman.free(sending);
+  bufman.purge();
+}
+
+// producer thread commits buffers while the consumer alternates newest and oldest as
+// telemetry() does, restoring some as if the send had failed
+static void stress(uint32_t buffers)
+{
+  bufman.init();
+  std::atomic<bool> done{false};
+  std::vector<uint8_t> seen(buffers + 1, 0);
+  std::vector<uint8_t> requeued(buffers + 1, 0);
+  uint32_t delivered = 0;
+  uint32_t restored = 0;
+
+  std::thread producer([&] {
+    for (uint32_t seq = 1; seq <= buffers; seq++) {
+      produce(seq);
+      if ((seq & 3) == 0) std::this_thread::yield();
+    }
+    done = true;
+  });
+
+  uint32_t lastCommits = 0;
+  uint32_t lastNewest = 0;
+  uint32_t lastOldest = 0;
+  for (uint32_t round = 0; ; round++) {
+    bool finished = done.load();
+    uint32_t commits = bufman.commits();
+    bool live = commits != lastCommits;
+    lastCommits = commits;
+    CBuffer* buffer = live ? bufman.getNewest() : bufman.getOldest();
+    if (!buffer) {
+      if (finished && bufman.queued() == 0) break;
+      std::this_thread::yield();
+      continue;
+    }
+    uint32_t seq = inspect(buffer);
+    // sending takes a while, so the producer commits more meanwhile
+    if (round % 3 == 0) std::this_thread::yield();
+    if (round % 7 == 3) {
+      if (live) {
+        requeued[seq] = 1;
+        bufman.restoreNewest(buffer);
+      } else {
+        bufman.restore(buffer);
+      }
+      restored++;
+      continue;
+    }
+    // the queue stays in commit order: every newest take is fresher than the previous one,
+    // and oldest takes never go back in time; only a requeued live buffer comes back later
+    if (!requeued[seq]) {
+      uint32_t& last = live ? lastNewest : lastOldest;
+      CHECK(seq > last);
+      last = seq;
+    }
+    CHECK(seq >= 1 && seq <= buffers && !seen[seq]);
+    seen[seq] = 1;
+    delivered++;
+    bufman.free(buffer);
+    if (checkFailures) break;
+  }
+  producer.join();
+  // a buffer handed back by restoreNewest() is queued by the next commit, or dropped by purge()
+  produce(buffers + 1);
+  for (CBuffer* buffer; (buffer = bufman.getOldest()); bufman.free(buffer)) {
+    uint32_t seq = inspect(buffer);
+    if (seq <= buffers) {
+      CHECK(!seen[seq]);
+      seen[seq] = 1;
+      delivered++;
+    }
+  }
+  printf("%u buffers: %u delivered, %u dropped, %u restored\n",
+    (unsigned)buffers, (unsigned)delivered, (unsigned)bufman.dropped(), (unsigned)restored);
+  // nothing is lost: each buffer was either delivered exactly once or counted as dropped
+  CHECK_EQ(delivered + bufman.dropped(), buffers);
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t buffers = argc > 1 ? atoi(argv[1]) : 200000;
+  checkSingleThread();
+  stress(buffers);
+  return checkResult("test_buffer_ring");
+}
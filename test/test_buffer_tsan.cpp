@@ -0,0 +1,164 @@
+/*************************************************************************
+* ThreadSanitizer harness for the buffer hand-over between process()
+* (loop task) and telemetry() (telemetry task), and for the response
+* cache shared by the acquisition task and the live data readers
+*
+* Both sides run every path that touches shared buffers concurrently:
+* acquire/commit/free and purge() on the producer, take/serialize/
+* restore/free and purge() on the consumer. The cache writer puts replies
+* and flips the ignition state while a reader gets and lists them.
+* Built with -fsanitize=thread, any unsynchronized access fails the run.
+*
+*   test_buffer_tsan [iterations]
+*************************************************************************/
+
+#include <atomic>
+#include <stdlib.h>
+#include <thread>
+#include "telebuffer.h"
+#include "telestore.h"
+#include "CAN-cache.h"
+#include "CAN-poll.h"
+#include "check.h"
+
+#define PID_SEQUENCE 0x101
+// DIDs the cache writer cycles through
+#define CACHE_DIDS 6
+
+static CBufferManager bufman;
+static std::atomic<bool> producing{true};
+static std::atomic<uint32_t> serialized{0};
+static CResponseCache cache;
+static std::atomic<uint32_t> cacheClock{0};
+static std::atomic<uint32_t> cacheHits{0};
+
+// loop task: fills buffers like process(), abandons some, purges on standby
+static void loopTask(uint32_t iterations)
+{
+  for (uint32_t seq = 1; seq <= iterations; seq++) {
+    CBuffer* buffer = bufman.acquire();
+    buffer->timestamp = seq;
+    buffer->add(PID_SEQUENCE, ELEMENT_UINT32, &seq, sizeof(seq));
+    float voltage = 12.5f;
+    buffer->add(0x24, ELEMENT_FLOAT_D1, &voltage, sizeof(voltage));
+    uint8_t payload[64] = {0};
+    buffer->add(0x20, ELEMENT_UINT8, payload, seq % sizeof(payload) + 1, seq % sizeof(payload) + 1);
+    if (seq % 17 == 0) {
+      // no samples this round, e.g. the ECU went off
+      bufman.free(buffer);
+    } else {
+      bufman.commit(buffer);
+    }
+    if (seq % 251 == 0) bufman.purge();
+    if (seq % 1021 == 0) bufman.printStats();
+    if (seq % 8 == 0) std::this_thread::yield();
+  }
+  producing = false;
+}
+
+// telemetry task: serializes the newest or oldest buffer, restores failed sends, purges on overheat
+static void telemetryTask()
+{
+  static char cache[2048];
+  CStorageRAM store;
+  store.init(cache, sizeof(cache));
+  uint32_t lastCommits = 0;
+  for (uint32_t round = 0; ; round++) {
+    bool finished = !producing.load();
+    uint32_t commits = bufman.commits();
+    bool live = commits != lastCommits;
+    lastCommits = commits;
+    CBuffer* buffer = live ? bufman.getNewest() : bufman.getOldest();
+    if (!buffer) {
+      if (finished) break;
+      std::this_thread::yield();
+      continue;
+    }
+    store.purge();
+    store.header("TEST");
+    store.timestamp(buffer->timestamp);
+    buffer->serialize(store);
+    store.tailer();
+    char expect[24];
+    snprintf(expect, sizeof(expect), "%X:%u", PID_SEQUENCE, (unsigned)buffer->timestamp);
+    CHECK(strstr(store.buffer(), expect) != 0);
+    serialized++;
+    if (round % 5 == 0) std::this_thread::yield();
+    if (round % 7 == 3) {
+      if (live) {
+        bufman.restoreNewest(buffer);
+      } else {
+        bufman.restore(buffer);
+      }
+    } else {
+      bufman.free(buffer);
+    }
+    if (round % 509 == 0) bufman.purge();
+  }
+}
+
+// acquisition task: stores DID replies whose length and bytes follow from their value
+static void cacheWriter(uint32_t iterations)
+{
+  uint8_t reply[CACHE_MAX_DATA];
+  for (uint32_t seq = 1; seq <= iterations; seq++) {
+    uint16_t len = 4 + seq % (CACHE_MAX_DATA - 4);
+    memset(reply, (uint8_t)seq, len);
+    uint32_t did = 0x220100 + seq % CACHE_DIDS;
+    cache.put(POLL_UDS_DID, 0x7E4, did, seq, reply, len, 1000000, seq & 1 ? CACHE_IGNITION : 0, seq);
+    cacheClock.store(seq, std::memory_order_relaxed);
+    if (seq % 97 == 0) cache.setIgnition(seq % 194 == 0);
+    if (seq % 8 == 0) std::this_thread::yield();
+  }
+}
+
+// live data reader: every reply it is handed must be one the writer stored in one piece
+static void checkReply(const CacheReply& reply)
+{
+  CHECK_EQ(reply.len, 4 + reply.value % (CACHE_MAX_DATA - 4));
+  for (uint16_t i = 0; i < reply.len; i++) {
+    if (reply.data[i] != (uint8_t)reply.value) {
+      CHECK_EQ(reply.data[i], (uint8_t)reply.value);
+      break;
+    }
+  }
+}
+
+static void cacheReader()
+{
+  CacheReply reply;
+  while (producing.load()) {
+    uint32_t now = cacheClock.load(std::memory_order_relaxed);
+    for (uint32_t did = 0x220100; did < 0x220100 + CACHE_DIDS; did++) {
+      if (cache.get(POLL_UDS_DID, 0x7E4, did, now, reply)) {
+        CHECK_EQ(reply.id, did);
+        checkReply(reply);
+        cacheHits++;
+      }
+    }
+    for (uint8_t i = 0; i < cache.count(); i++) {
+      if (cache.at(i, now, reply)) checkReply(reply);
+    }
+    std::this_thread::yield();
+  }
+}
+
+int main(int argc, char** argv)
+{
+  uint32_t iterations = argc > 1 ? atoi(argv[1]) : 20000;
+  bufman.init();
+  std::thread consumer(telemetryTask);
+  std::thread reader(cacheReader);
+  std::thread writer(cacheWriter, iterations);
+  loopTask(iterations);
+  writer.join();
+  consumer.join();
+  reader.join();
+  bufman.purge();
+  CHECK(serialized > 0);
+  CHECK_EQ(bufman.queued(), 0);
+  CHECK(cacheHits > 0);
+  printf("%u buffers, %u serialized, %u dropped; %u cache hits, %u misses\n", (unsigned)iterations,
+    (unsigned)serialized.load(), (unsigned)bufman.dropped(), (unsigned)cacheHits.load(), (unsigned)cache.misses());
+  return checkResult("test_buffer_tsan");
+}
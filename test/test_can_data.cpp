@@ -0,0 +1,100 @@
+/*************************************************************************
+* Signal table decoding (CAN-data.cpp) against captured Kia EV9 responses
+*************************************************************************/
+
+#include <math.h>
+#include "CAN-data.h"
+#include "check.h"
+
+#define CHECK_NEAR(a, b) CHECK(fabs((a) - (b)) < 0.001)
+
+int main()
+{
+  // BMS 7E4 220101 while DC fast charging
+  {
+    const uint8_t r[] = {0x62, 0x01, 0x01, 0xFF, 0xF7, 0xE7, 0xFF, 0xA0, 0x00, 0x00, 0x00, 0x00, 0xA0,
+      0xFF, 0x9C, 0x0F, 0xA0, 0x14, 0x12, 0x13};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeAbrpTelemetry(0x7E4, 0x220101, r, sizeof(r), d), 6);
+    CHECK(d.soc_valid);
+    CHECK_NEAR(d.soc, 80.0f);
+    CHECK(d.is_charging_valid && d.is_charging);
+    CHECK(d.is_dcfc_valid && d.is_dcfc);
+    CHECK(d.current_valid);
+    CHECK_NEAR(d.current, -10.0f);
+    CHECK(d.voltage_valid);
+    CHECK_NEAR(d.voltage, 400.0f);
+    CHECK(d.batt_temp_valid);
+    CHECK_NEAR(d.batt_temp, 19.0f);
+    CHECK(d.power_valid);
+    CHECK_NEAR(d.power, -4.0f);
+    CHECK(!d.soh_valid && !d.odometer_valid);
+  }
+
+  // signals past the end of a short response are skipped, the rest still decode
+  {
+    const uint8_t r[] = {0x62, 0x01, 0x01, 0xFF, 0xF7, 0xE7, 0xFF, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeAbrpTelemetry(0x7E4, 0x220101, r, sizeof(r), d), 3);
+    CHECK_NEAR(d.soc, 50.0f);
+    CHECK(d.is_charging_valid && !d.is_charging);
+    CHECK(d.is_dcfc_valid && !d.is_dcfc);
+    CHECK(!d.current_valid && !d.voltage_valid && !d.power_valid);
+  }
+
+  // same DID from another ECU, or another DID, decodes nothing
+  {
+    const uint8_t r[20] = {0x62, 0x01, 0x01};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeAbrpTelemetry(0x7E0, 0x220101, r, sizeof(r), d), 0);
+    CHECK_EQ(decodeAbrpTelemetry(0x7E4, 0x220102, r, sizeof(r), d), 0);
+    CHECK(!d.soc_valid);
+  }
+
+  // AIRCON 7B3 220100 temperatures with offset, cluster odometer as 24 bits
+  {
+    const uint8_t aircon[] = {0x62, 0x01, 0x00, 0, 0, 0, 0, 0, 0x64, 0x5A};
+    const uint8_t cluster[] = {0x62, 0xB0, 0x02, 0, 0, 0, 0, 0, 0, 0x01, 0x86, 0xA0};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeAbrpTelemetry(0x7B3, 0x220100, aircon, sizeof(aircon), d), 2);
+    CHECK_NEAR(d.cabin_temp, 10.0f);
+    CHECK_NEAR(d.ext_temp, 5.0f);
+    CHECK_EQ(decodeAbrpTelemetry(0x7C6, 0x22B002, cluster, sizeof(cluster), d), 1);
+    CHECK_NEAR(d.odometer, 100000.0f);
+    CHECK(!d.power_valid);
+  }
+
+  // bit fields inside a byte and sign extension of narrow fields
+  {
+    const CanSignal table[] = {
+      {0x100, CAN_SIGNAL_BROADCAST, 0, 4, 4, true, 1.0f, 0.0f, &AbrpTelemetry::heading, nullptr, &AbrpTelemetry::heading_valid},
+      {0x100, CAN_SIGNAL_BROADCAST, 0, 0, 4, false, 2.0f, 1.0f, &AbrpTelemetry::speed, nullptr, &AbrpTelemetry::speed_valid},
+      {0x100, CAN_SIGNAL_BROADCAST, 1, 3, 10, false, 1.0f, 0.0f, &AbrpTelemetry::elevation, nullptr, &AbrpTelemetry::elevation_valid},
+      {0x100, CAN_SIGNAL_BROADCAST, 3, 0, 0, false, 1.0f, 0.0f, &AbrpTelemetry::capacity, nullptr, &AbrpTelemetry::capacity_valid},
+    };
+    // byte 0: 0xE3 -> high nibble -2, low nibble 3; bytes 1-2: 0x1FF8 >> 3 = 0x3FF
+    const uint8_t frame[] = {0xE3, 0x1F, 0xF8, 0x00};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeCanSignals(table, 4, 0x100, CAN_SIGNAL_BROADCAST, frame, sizeof(frame), d), 3);
+    CHECK_NEAR(d.heading, -2.0f);
+    CHECK_NEAR(d.speed, 7.0f);
+    CHECK_NEAR(d.elevation, 1023.0f);
+    CHECK(!d.capacity_valid);
+  }
+
+  // the cluster speed broadcast is the one EV9 frame to monitor
+  {
+    uint32_t ids[4];
+    CHECK_EQ(getBroadcastIds(ids, 4), 1);
+    CHECK_EQ(ids[0], 0x4F1);
+    CHECK_EQ(getBroadcastIds(ids, 0), 0);
+    const uint8_t frame[] = {0x00, 0x64, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00};
+    AbrpTelemetry d;
+    CHECK_EQ(decodeAbrpTelemetry(0x4F1, CAN_SIGNAL_BROADCAST, frame, sizeof(frame), d), 1);
+    CHECK(d.speed_valid);
+    CHECK_NEAR(d.speed, 100.0f);
+    // a polled reply never matches a broadcast row
+    CHECK_EQ(decodeAbrpTelemetry(0x4F1, 0x220101, frame, sizeof(frame), d), 0);
+  }
+  return checkResult("test_can_data");
+}
@@ -0,0 +1,155 @@
+/*************************************************************************
+* Broadcast capture in monitor mode (COBD::startMonitor/receiveFrame/
+* stopMonitor) decoded with the vehicle signal table, recorded through
+* CTraceLink and replayed through CReplayLink
+*************************************************************************/
+
+#include <string>
+#include <vector>
+#include <FreematicsPlus.h>
+#include "CAN-data.h"
+#include "check.h"
+
+class CHostOBD : public COBD
+{
+protected:
+  void idleTasks() {}
+};
+
+// adapter acknowledging AT commands and streaming frames once ATM1 is sent, until interrupted
+class CMonitorAdapter : public CLink {
+public:
+  int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+  {
+    send(cmd);
+    const char* reply = !strcmp(cmd, "\r") ? "STOPPED\r" : "OK\r";
+    int len = snprintf(buf, bufsize, "%s", reply);
+    return len < bufsize ? len : bufsize - 1;
+  }
+  bool send(const char* str)
+  {
+    log.push_back(str);
+    m_monitoring = !strcmp(str, "ATM1\r");
+    if (m_monitoring) m_pos = 0;
+    return true;
+  }
+  int read()
+  {
+    return m_monitoring && m_pos < stream.size() ? (uint8_t)stream[m_pos++] : -1;
+  }
+  std::vector<std::string> log;
+  std::string stream;
+private:
+  bool m_monitoring = false;
+  size_t m_pos = 0;
+};
+
+// one monitor window as in processCANMonitor(), ending once the bus has been quiet for 20 ms
+static int capture(COBD& obd, const uint32_t ids[], uint8_t count, AbrpTelemetry& telemetry)
+{
+  if (!obd.startMonitor(ids, count)) return -1;
+  int frames = 0;
+  uint32_t id;
+  uint8_t data[8];
+  uint32_t stamp = 0;
+  for (int len; (len = obd.receiveFrame(id, data, sizeof(data), 20, &stamp)); ) {
+    if (decodeAbrpTelemetry(id, CAN_SIGNAL_BROADCAST, data, len, telemetry)) {
+      telemetry.broadcast_ts = stamp;
+      frames++;
+    }
+  }
+  obd.stopMonitor();
+  return frames;
+}
+
+static std::string joined(const std::vector<std::string>& log, size_t from)
+{
+  std::string s;
+  for (size_t i = from; i < log.size(); i++) s += log[i];
+  return s;
+}
+
+// collects the trace in memory instead of an SD file
+class CMemoryPrint : public Print {
+public:
+  size_t write(uint8_t c)
+  {
+    data.push_back(c);
+    return 1;
+  }
+  std::vector<uint8_t> data;
+};
+
+int main()
+{
+  // the EV9 table lists its broadcast frames for the monitor filter
+  uint32_t ids[4];
+  CHECK_EQ(getBroadcastIds(ids, 4), 1);
+  CHECK_EQ(ids[0], 0x4F1);
+
+  CMonitorAdapter adapter;
+  adapter.stream =
+    "7E8 03 41 0D 32\r"                  // passes the adapter mask, dropped in software
+    "4F1 00 50 00 00 00 00 00 00\r"      // 80 km/h
+    "SEARCHING...\r"
+    "4F1 00 5A 00 00 00 00 00 00\r";     // 90 km/h, latest value wins
+  CMemoryPrint out;
+  CTraceLink trace;
+  trace.wrap(&adapter);
+  trace.attach(&out);
+  CHostOBD obd;
+  obd.begin(&trace);
+  // response filter of a functional OBD-II request, as processOBD() leaves it
+  obd.setHeaderMask(0x7F8);
+  obd.setHeaderFilter(0x7E8);
+  size_t mark = adapter.log.size();
+  AbrpTelemetry recorded;
+  CHECK_EQ(capture(obd, ids, 1, recorded), 2);
+  CHECK(recorded.speed_valid);
+  CHECK_EQ(recorded.speed, 90);
+  CHECK(joined(adapter.log, mark) ==
+    "ATCM 7FF\rATCF 4F1\rATH1\rATM1\r" "\rATM0\rATH0\rATCM 7F8\rATCF 7E8\r");
+  // the filter cache holds the restored state, so the next request sends no header commands
+  mark = adapter.log.size();
+  obd.setHeaderMask(0x7F8);
+  obd.setHeaderFilter(0x7E8);
+  CHECK_EQ(adapter.log.size(), mark);
+  trace.flush();
+
+  // replaying the recorded session decodes the same frames
+  CReplayLink replay;
+  CHECK(replay.load(out.data.data(), out.data.size()));
+  CHostOBD replayed;
+  replayed.begin(&replay);
+  replayed.setHeaderMask(0x7F8);
+  replayed.setHeaderFilter(0x7E8);
+  AbrpTelemetry telemetry;
+  CHECK_EQ(capture(replayed, ids, 1, telemetry), 2);
+  CHECK_EQ(telemetry.speed, 90);
+  CHECK(replay.done());
+  CHECK_EQ(replay.mismatches(), 0);
+
+  // 29-bit IDs, printed with and without spaces; the mask keeps the bits both IDs share
+  const uint32_t ext[] = {0x18FF1021, 0x18FF1121};
+  adapter.stream =
+    "18 FF 10 21 01 02\r"
+    "18FF1121 03 04 05\r"
+    "18 FF 12 21 06\r";
+  mark = adapter.log.size();
+  CHECK(obd.startMonitor(ext, 2));
+  CHECK(joined(adapter.log, mark) == "ATCM 1FFFFEFF\rATCF 18FF1021\rATH1\rATM1\r");
+  uint32_t id = 0;
+  uint8_t data[8];
+  CHECK_EQ(obd.receiveFrame(id, data, sizeof(data), 20), 2);
+  CHECK_EQ(id, 0x18FF1021);
+  CHECK(data[0] == 0x01 && data[1] == 0x02);
+  CHECK_EQ(obd.receiveFrame(id, data, sizeof(data), 20), 3);
+  CHECK_EQ(id, 0x18FF1121);
+  CHECK_EQ(obd.receiveFrame(id, data, sizeof(data), 20), 0);
+  obd.stopMonitor();
+
+  // one filter cannot match 11-bit and 29-bit IDs at once
+  const uint32_t mixed[] = {0x4F1, 0x18FF1021};
+  CHECK(!obd.startMonitor(mixed, 2));
+  return checkResult("test_can_monitor");
+}
@@ -0,0 +1,176 @@
+/*************************************************************************
+* Non-blocking COBD requests (submitPID/submitCAN/submitCommand, poll)
+* against a simulated adapter byte stream
+*************************************************************************/
+
+#include <deque>
+#include <map>
+#include <string>
+#include "FreematicsBase.h"
+#include "FreematicsOBD.h"
+#include "check.h"
+
+// adapter answering each command after a delay, byte by byte through read()
+class CMockAdapter : public CLink {
+public:
+  bool send(const char* str)
+  {
+    log += str;
+    std::map<std::string, std::string>::const_iterator it = replies.find(str);
+    if (it != replies.end()) {
+      m_queue.push_back(Reply{it->second, millis() + (delays.count(str) ? delays[str] : latency)});
+    } else if (!strncmp(str, "AT", 2)) {
+      m_queue.push_back(Reply{"OK\r\r>", millis() + latency});
+    }
+    return true;
+  }
+  int read()
+  {
+    if (m_queue.empty() || (long)(millis() - m_queue.front().readyAt) < 0) return -1;
+    Reply& r = m_queue.front();
+    int c = (uint8_t)r.text[m_pos++];
+    if (m_pos == r.text.size()) {
+      m_queue.pop_front();
+      m_pos = 0;
+    }
+    return c;
+  }
+  std::map<std::string, std::string> replies;
+  std::map<std::string, unsigned long> delays;
+  std::string log;
+  unsigned long latency = 5;
+private:
+  struct Reply {
+    std::string text;
+    unsigned long readyAt;
+  };
+  std::deque<Reply> m_queue;
+  size_t m_pos = 0;
+};
+
+static int callbacks = 0;
+static std::string callbackReply;
+
+static void onReply(const OBD_ASYNC* req, void* ctx)
+{
+  callbacks++;
+  if (req->status == OBD_ASYNC_DONE) callbackReply = req->reply;
+  *(int*)ctx = req->status;
+}
+
+// polls like the main loop until nothing is pending or the deadline passes
+static int pollAll(COBD& obd, unsigned long timeout = 2000)
+{
+  int completed = 0;
+  unsigned long start = millis();
+  while (obd.pending() && millis() - start < timeout) {
+    completed += obd.poll();
+    delay(1);
+  }
+  return completed;
+}
+
+int main()
+{
+  CMockAdapter adapter;
+  COBD obd;
+  obd.begin(&adapter);
+  adapter.replies["010D0C\r"] = "41 0D 32 0C 0B B8\r\r>";
+  adapter.replies["22F190\r"] = "62 F1 90 01\r\r>";
+  adapter.replies["ATRV\r"] = "12.5V\r\r>";
+  adapter.replies["010D\r"] = "SEARCHING...\r41 0D 10\r\r>";
+  adapter.replies["0105\r"] = "NO DATA\r\r>";
+
+  // four requests pipelined in submission order, one per prompt
+  {
+    const byte pids[] = {PID_SPEED, PID_RPM};
+    const byte speed[] = {PID_SPEED};
+    const byte uds[] = {0x22, 0xF1, 0x90};
+    int udsStatus = -1;
+    int h1 = obd.submitPID(pids, 2);
+    int h2 = obd.submitCAN(0x7E0, uds, sizeof(uds), 100, onReply, &udsStatus);
+    int h3 = obd.submitCommand("ATRV\r", 500);
+    int h4 = obd.submitPID(speed, 1);
+    CHECK(h1 >= 0 && h2 >= 0 && h3 >= 0 && h4 >= 0);
+    CHECK_EQ(obd.submitCommand("ATI\r", 100), -1);
+    CHECK_EQ(obd.pending(), 4);
+    CHECK(adapter.log.empty());
+
+    // the first poll only sends; nothing is waited for
+    CHECK_EQ(obd.poll(), 0);
+    CHECK(adapter.log == "010D0C\r");
+    CHECK(!obd.release(h1));
+    CHECK_EQ(pollAll(obd), 4);
+    CHECK(adapter.log == "010D0C\rATSH 7E0\r22F190\rATRV\r010D\r");
+
+    const OBD_ASYNC* r = obd.getAsync(h1);
+    CHECK(r && r->status == OBD_ASYNC_DONE);
+    CHECK(r && r->success[0] && r->success[1]);
+    CHECK(r && r->result[0] == 50 && r->result[1] == 750);
+    // requests with a callback are released as soon as it returns
+    CHECK_EQ(callbacks, 1);
+    CHECK_EQ(udsStatus, OBD_ASYNC_DONE);
+    CHECK(callbackReply == "62 F1 90 01\r\r");
+    CHECK(obd.getAsync(h2) == 0);
+    r = obd.getAsync(h3);
+    CHECK(r && r->status == OBD_ASYNC_DONE && !strcmp(r->reply, "12.5V\r\r"));
+    // "SEARCHING..." is dropped from the reply
+    r = obd.getAsync(h4);
+    CHECK(r && r->status == OBD_ASYNC_DONE && r->success[0] && r->result[0] == 16);
+    CHECK(obd.release(h1) && obd.release(h3) && obd.release(h4));
+    CHECK(!obd.release(h4 + OBD_ASYNC_SLOTS));
+  }
+
+  // the header is only switched again for another CAN ID
+  {
+    const byte uds[] = {0x22, 0xF1, 0x90};
+    adapter.log.clear();
+    int h = obd.submitCAN(0x7E0, uds, sizeof(uds));
+    pollAll(obd);
+    CHECK(adapter.log == "22F190\r");
+    CHECK(obd.getAsync(h) && obd.getAsync(h)->status == OBD_ASYNC_DONE);
+    obd.release(h);
+  }
+
+  // an adapter error token fails the request and counts as an OBD error
+  {
+    const byte pids[] = {PID_COOLANT_TEMP};
+    byte errors = obd.errors;
+    int h = obd.submitPID(pids, 1);
+    pollAll(obd);
+    const OBD_ASYNC* r = obd.getAsync(h);
+    CHECK(r && r->status == OBD_ASYNC_FAILED && r->error == 4 && !r->success[0]);
+    CHECK_EQ(obd.errors, errors + 1);
+    obd.release(h);
+  }
+
+  // a queued request can be cancelled before it is sent
+  {
+    int h1 = obd.submitCommand("ATRV\r", 500);
+    int h2 = obd.submitCommand("ATRV\r", 500);
+    CHECK(obd.release(h2));
+    CHECK_EQ(obd.pending(), 1);
+    pollAll(obd);
+    CHECK(obd.getAsync(h2) == 0);
+    obd.release(h1);
+  }
+
+  // a timed-out request fails; its late reply is flushed instead of completing the next one
+  {
+    adapter.replies["0100\r"] = "41 00 BE 1F A8 13\r\r>";
+    adapter.delays["0100\r"] = 60;
+    int h1 = obd.submitCommand("0100\r", 20);
+    pollAll(obd);
+    const OBD_ASYNC* r = obd.getAsync(h1);
+    CHECK(r && r->status == OBD_ASYNC_FAILED && r->elapsed >= 20);
+    delay(60);
+    int h2 = obd.submitCommand("ATRV\r", 500);
+    pollAll(obd);
+    r = obd.getAsync(h2);
+    CHECK(r && r->status == OBD_ASYNC_DONE && !strcmp(r->reply, "12.5V\r\r"));
+    obd.release(h1);
+    obd.release(h2);
+  }
+  CHECK_EQ(obd.pending(), 0);
+  return checkResult("test_obd_async");
+}
@@ -0,0 +1,112 @@
+/*************************************************************************
+* Multi-PID mode 01 requests (COBD::readPID with a PID array) against
+* recorded adapter replies
+*************************************************************************/
+
+#include <string>
+#include <vector>
+#include "FreematicsBase.h"
+#include "FreematicsOBD.h"
+#include "check.h"
+
+// hands out one scripted reply per request and remembers the last request
+class CMockLink : public CLink {
+public:
+  bool send(const char* str)
+  {
+    requests.push_back(str);
+    return true;
+  }
+  int receive(char* buffer, int bufsize, unsigned int timeout)
+  {
+    if (next >= replies.size()) return 0;
+    int len = snprintf(buffer, bufsize, "%s", replies[next++].c_str());
+    return len < bufsize ? len : bufsize - 1;
+  }
+  int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+  {
+    send(cmd);
+    return receive(buf, bufsize, timeout);
+  }
+  void script(const std::vector<std::string>& list)
+  {
+    replies = list;
+    next = 0;
+  }
+  std::vector<std::string> replies;
+  std::vector<std::string> requests;
+  size_t next = 0;
+};
+
+int main()
+{
+  CMockLink link;
+  COBD obd;
+  obd.begin(&link);
+
+  // speed, RPM and throttle in one single-frame reply
+  {
+    const byte pids[] = {PID_SPEED, PID_RPM, PID_THROTTLE};
+    int values[3];
+    bool success[3];
+    link.script({"41 0D 32 0C 0B B8 11 20\r"});
+    CHECK_EQ(obd.readPID(pids, 3, values, success), 3);
+    CHECK(link.requests.back() == "010D0C11\r");
+    CHECK(success[0] && success[1] && success[2]);
+    CHECK_EQ(values[0], 50);
+    CHECK_EQ(values[1], 750);
+    CHECK_EQ(values[2], 0x20 * 100 / 255);
+  }
+
+  // multi-frame reply: the numbered lines are joined and the padding after the
+  // announced 8 bytes is not taken for PID 00
+  {
+    const byte pids[] = {PID_SPEED, PID_RPM, PID_THROTTLE, 0x00};
+    int values[4];
+    bool success[4];
+    link.script({"008\r0: 41 0D 32 0C 0B B8\r1: 11 20 00 00 00 00 00\r"});
+    CHECK_EQ(obd.readPID(pids, 4, values, success), 3);
+    CHECK(success[0] && success[1] && success[2]);
+    CHECK(!success[3]);
+    CHECK_EQ(values[1], 750);
+  }
+
+  // two ECUs answering with different PIDs
+  {
+    const byte pids[] = {PID_SPEED, PID_RPM};
+    int values[2];
+    bool success[2];
+    link.script({"41 0D 10\r41 0C 0F A0\r"});
+    CHECK_EQ(obd.readPID(pids, 2, values, success), 2);
+    CHECK_EQ(values[0], 16);
+    CHECK_EQ(values[1], 1000);
+  }
+
+  // no answer: every PID fails and the error counter goes up
+  {
+    const byte pids[] = {PID_SPEED, PID_RPM};
+    int values[2];
+    bool success[2] = {true, true};
+    byte errors = obd.errors;
+    link.script({"NO DATA\r"});
+    CHECK_EQ(obd.readPID(pids, 2, values, success), 0);
+    CHECK(!success[0] && !success[1]);
+    CHECK_EQ(obd.errors, errors + 1);
+  }
+
+  // more PIDs than fit in one request are split into batches
+  {
+    const byte pids[] = {PID_ENGINE_LOAD, PID_COOLANT_TEMP, 0x06, PID_RPM, PID_SPEED, PID_THROTTLE, PID_AMBIENT_TEMP};
+    int values[7];
+    bool success[7];
+    link.script({"41 04 10 05 50 06 80 0C 10 00 0D 20 11 40\r", "41 46 50\r"});
+    size_t sent = link.requests.size();
+    CHECK_EQ(obd.readPID(pids, 7, values, success), 7);
+    CHECK_EQ(link.requests.size() - sent, 2);
+    CHECK(link.requests.back() == "0146\r");
+    CHECK_EQ(values[4], 0x20);
+    CHECK_EQ(values[6], 0x50 - 40);
+  }
+
+  return checkResult("test_obd_batch");
+}
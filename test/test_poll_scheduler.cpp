@@ -0,0 +1,211 @@
+/*************************************************************************
+* Poll scheduler (CAN-poll.cpp): deadline ordering, cycle budget, backoff
+* of failing requests and the achieved-rate report
+*************************************************************************/
+
+#include <string>
+#include <unistd.h>
+#include "CAN-poll.h"
+#include "check.h"
+
+// runs printStats() with stdout redirected and returns what it logged
+static std::string captureStats(CPollScheduler& poller, uint32_t now)
+{
+  fflush(stdout);
+  FILE* out = tmpfile();
+  int saved = dup(fileno(stdout));
+  dup2(fileno(out), fileno(stdout));
+  poller.printStats(now);
+  fflush(stdout);
+  dup2(saved, fileno(stdout));
+  close(saved);
+  std::string text;
+  rewind(out);
+  for (int c; (c = fgetc(out)) != EOF; ) text += (char)c;
+  fclose(out);
+  return text;
+}
+
+static void checkDeadlines()
+{
+  PollEntry table[] = {
+    {"slow", POLL_OBD_PID, 0, 0x05, 5000, 2},
+    {"fast", POLL_OBD_PID, 0, 0x0D, 500, 0},
+    {"mid", POLL_UDS_DID, 0x7E4, 0x220101, 1000, 1},
+  };
+  CPollScheduler poller;
+  poller.begin(table, 3, 1000);
+  CHECK_EQ(poller.count(), 3);
+
+  // everything is due at begin(), so priority breaks the tie
+  CHECK_EQ(poller.next(1000, 400), 1);
+  poller.complete(1, true, 1000, 20);
+  CHECK_EQ(poller.next(1000, 400), 2);
+  poller.complete(2, true, 1000, 20);
+  CHECK_EQ(poller.next(1000, 400), 0);
+  poller.complete(0, true, 1000, 20);
+  CHECK_EQ(poller.next(1000, 400), -1);
+
+  // then the earliest deadline goes first, whatever the priority
+  CHECK_EQ(poller.next(1499, 400), -1);
+  CHECK_EQ(poller.next(1500, 400), 1);
+  CHECK_EQ(poller.next(2500, 400), 1);
+  poller.complete(1, true, 2500, 20);
+  CHECK_EQ(table[1].due, 2500);  // fell behind: due now instead of a burst of catch-up requests
+  CHECK_EQ(poller.next(2500, 400), 2);
+  poller.complete(2, true, 2500, 20);
+  CHECK_EQ(table[2].due, 3000);  // on time: keeps its phase
+  CHECK_EQ(poller.next(6000, 400), 1);
+  poller.defer(1, 7000);
+  CHECK_EQ(poller.next(6000, 400), 2);
+  poller.defer(2, 7000);
+  CHECK_EQ(poller.next(6000, 400), 0);
+
+  // idle time until the earliest deadline, which the monitor window may use
+  CHECK_EQ(poller.idleTime(6000), 0);
+  poller.defer(0, 6500);
+  CHECK_EQ(poller.idleTime(6000), 500);
+  CHECK_EQ(poller.idleTime(6500), 0);
+
+  // deadlines compare across the millis() wrap
+  poller.begin(table, 3, 0xffffff00);
+  poller.complete(1, true, 0xffffff00, 20);
+  poller.complete(2, true, 0xffffff00, 20);
+  poller.complete(0, true, 0xffffff00, 20);
+  CHECK_EQ(table[1].due, 0xffffff00 + 500);
+  CHECK_EQ(poller.next(0xffffffff, 400), -1);
+  CHECK_EQ(poller.next(0x100, 400), 1);
+
+  // periods overridden by name, as /cfg/poll.ini does
+  CHECK(poller.setPeriod("mid", 250));
+  CHECK_EQ(table[2].period, 250);
+  CHECK(!poller.setPeriod("none", 250));
+  CHECK(!poller.setPeriod("mid", 0));
+
+  // due entries of the same kind and CAN ID are collected into one request
+  PollEntry batch[] = {
+    {"a", POLL_OBD_PID, 0, 0x0C, 1000, 0},
+    {"b", POLL_UDS_DID, 0x7E4, 0x220101, 1000, 0},
+    {"c", POLL_OBD_PID, 0, 0x0D, 1000, 0},
+    {"d", POLL_OBD_PID, 0, 0x11, 1000, 0},
+    {"e", POLL_UDS_DID, 0x7E4, 0x220105, 1000, 0},
+    {"f", POLL_UDS_DID, 0x744, 0x22E001, 1000, 0},
+  };
+  poller.begin(batch, 6, 0);
+  poller.defer(3, 100);
+  int out[6];
+  CHECK_EQ(poller.collect(0, 0, out, 6), 2);
+  CHECK(out[0] == 0 && out[1] == 2);
+  CHECK_EQ(poller.collect(0, 100, out, 6), 3);
+  CHECK_EQ(poller.collect(0, 100, out, 2), 2);
+  CHECK_EQ(poller.collect(1, 0, out, 6), 2);
+  CHECK(out[0] == 1 && out[1] == 4);
+  CHECK_EQ(poller.collect(-1, 0, out, 6), 0);
+}
+
+static void checkBudget()
+{
+  PollEntry table[] = {
+    {"cheap", POLL_OBD_PID, 0, 0x0D, 1000, 1},
+    {"dear", POLL_UDS_DID, 0x7E4, 0x220101, 1000, 0},
+  };
+  CPollScheduler poller;
+  poller.begin(table, 2, 0);
+  CHECK_EQ(table[0].cost, POLL_DEFAULT_COST);
+
+  // the cost is a moving average, and a single timeout is capped before it is averaged in
+  poller.complete(1, true, 0, 1000);
+  CHECK_EQ(table[1].cost, (POLL_DEFAULT_COST * 3 + POLL_MAX_COST) / 4);
+  poller.complete(0, true, 0, 10);
+  CHECK_EQ(table[0].cost, (POLL_DEFAULT_COST * 3 + 10) / 4);
+  uint16_t cost = table[0].cost;
+  poller.complete(0, false, 0, 0);
+  CHECK_EQ(table[0].cost, cost);  // a request that was not sent leaves the estimate alone
+
+  // the earliest entry is skipped when it does not fit the rest of the cycle
+  poller.defer(0, 1000);
+  poller.defer(1, 1000);
+  CHECK_EQ(poller.next(1000, 400), 1);
+  CHECK_EQ(poller.next(1000, table[1].cost), 1);
+  CHECK_EQ(poller.next(1000, table[1].cost - 1), 0);
+  CHECK_EQ(poller.next(1000, cost - 1), -1);
+  // ... unless forced at the start of a cycle
+  CHECK_EQ(poller.next(1000, 0, true), 1);
+  CHECK_EQ(poller.next(999, 0, true), -1);
+}
+
+static void checkBackoff()
+{
+  PollEntry table[] = {
+    {"absent", POLL_UDS_DID, 0x7A0, 0x22C000, 1000, 0},
+    {"rare", POLL_UDS_DID, 0x7C6, 0x22B002, 2 * POLL_MAX_BACKOFF, 0},
+  };
+  CPollScheduler poller;
+  poller.begin(table, 2, 0);
+
+  // consecutive timeouts double the delay up to POLL_MAX_BACKOFF
+  uint32_t now = 0;
+  uint32_t expect = 1000;
+  for (int n = 1; n <= 12; n++) {
+    poller.complete(0, false, now, 200);
+    CHECK_EQ(table[0].failures, n);
+    CHECK_EQ(table[0].due - now, expect);
+    now = table[0].due;
+    expect = expect * 2 > POLL_MAX_BACKOFF ? POLL_MAX_BACKOFF : expect * 2;
+  }
+  // one good reply restores the period
+  now = table[0].due;
+  poller.complete(0, true, now, 20);
+  CHECK_EQ(table[0].failures, 0);
+  CHECK_EQ(table[0].due, now + 1000);
+  poller.complete(0, false, now + 1000, 200);
+  CHECK_EQ(table[0].due, now + 2000);
+
+  // an entry polled less often than the backoff cap is never retried sooner than its period
+  poller.complete(1, false, 0, 200);
+  CHECK_EQ(table[1].due, 2 * POLL_MAX_BACKOFF);
+  poller.complete(1, false, 0, 200);
+  CHECK_EQ(table[1].due, 2 * POLL_MAX_BACKOFF);
+}
+
+static void checkStats()
+{
+  PollEntry table[] = {
+    {"speed", POLL_OBD_PID, 0, 0x0D, 1000, 0},
+    {"bms_220101", POLL_UDS_DID, 0x7E4, 0x220101, 1000, 0},
+    {"tpms_22C000", POLL_UDS_DID, 0x7A0, 0x22C000, 60000, 2},
+  };
+  CPollScheduler poller;
+  poller.begin(table, 3, 5000);
+
+  // 10 s window: speed on target, the BMS DID at half the rate, the TPMS DID timing out
+  for (int n = 0; n < 10; n++) poller.complete(0, true, 5000 + n * 1000, 40);
+  for (int n = 0; n < 5; n++) poller.complete(1, true, 5000 + n * 2000, 0);
+  poller.complete(2, false, 5000, 400);
+  poller.complete(2, false, 65000, 400);
+  std::string report = captureStats(poller, 15000);
+  CHECK(report.find("[POLL] speed target:1000ms achieved:1000ms ok:10 fail:0 cost:") != std::string::npos);
+  CHECK(report.find("[POLL] bms_220101 target:1000ms achieved:2000ms ok:5 fail:0 cost:50ms\n") != std::string::npos);
+  CHECK(report.find("[POLL] tpms_22C000 target:60000ms achieved:0ms ok:0 fail:2 cost:") != std::string::npos);
+  // only the entry still failing is marked as backing off
+  size_t backoff = report.find(" (backoff)\n");
+  CHECK(backoff != std::string::npos && backoff > report.find("tpms_22C000"));
+  CHECK(report.find(" (backoff)", backoff + 1) == std::string::npos);
+
+  // the counts start over with the next window
+  CHECK_EQ(table[0].okCount, 0);
+  CHECK_EQ(table[2].failCount, 0);
+  poller.complete(0, true, 16000, 40);
+  poller.complete(0, true, 17000, 40);
+  report = captureStats(poller, 19000);
+  CHECK(report.find("[POLL] speed target:1000ms achieved:2000ms ok:2 fail:0") != std::string::npos);
+}
+
+int main()
+{
+  checkDeadlines();
+  checkBudget();
+  checkBackoff();
+  checkStats();
+  return checkResult("test_poll_scheduler");
+}
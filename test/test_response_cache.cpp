@@ -0,0 +1,87 @@
+/*************************************************************************
+* Response cache (CAN-cache.cpp): TTL expiry, reply age, ignition
+* invalidation, slot replacement and the hit/miss counters
+*************************************************************************/
+
+#include <string.h>
+#include "CAN-cache.h"
+#include "CAN-poll.h"
+#include "check.h"
+
+int main()
+{
+  CResponseCache cache;
+  CacheReply reply;
+  const uint8_t soh[] = {0x62, 0x01, 0x05, 0x03, 0xA2};
+
+  // a DID reply is served with its age until the TTL runs out
+  CHECK(cache.put(POLL_UDS_DID, 0x7E4, 0x220105, 0, soh, sizeof(soh), 1000, 0, 5000));
+  CHECK_EQ(cache.count(), 1);
+  CHECK(cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 5000, reply));
+  CHECK_EQ(reply.age, 0);
+  CHECK(cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 5999, reply));
+  CHECK_EQ(reply.age, 999);
+  CHECK_EQ(reply.canId, 0x7E4);
+  CHECK_EQ(reply.len, sizeof(soh));
+  CHECK(!memcmp(reply.data, soh, sizeof(soh)));
+  CHECK_EQ(cache.remaining(POLL_UDS_DID, 0x7E4, 0x220105, 5400), 600);
+  CHECK(!cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 6000, reply));
+  CHECK_EQ(cache.remaining(POLL_UDS_DID, 0x7E4, 0x220105, 6000), 0);
+  CHECK_EQ(cache.hits(), 2);
+  CHECK_EQ(cache.misses(), 1);
+
+  // keys differ by kind, CAN ID and ID; a new reply to the same key replaces the old one
+  CHECK(!cache.get(POLL_UDS_DID, 0x7E5, 0x220105, 5000, reply));
+  CHECK(!cache.get(POLL_OBD_PID, 0x7E4, 0x220105, 5000, reply));
+  CHECK(cache.put(POLL_OBD_PID, 0, 0x0D, 88, 0, 0, 2000, 0, 7000));
+  CHECK(cache.put(POLL_OBD_PID, 0, 0x0D, 90, 0, 0, 2000, 0, 8000));
+  CHECK_EQ(cache.count(), 2);
+  CHECK(cache.get(POLL_OBD_PID, 0, 0x0D, 8500, reply));
+  CHECK_EQ(reply.value, 90);
+  CHECK_EQ(reply.age, 500);
+  CHECK_EQ(reply.len, 0);
+  // the millis() wrap does not expire a reply early
+  CHECK(cache.put(POLL_OBD_PID, 0, 0x0C, 3000, 0, 0, 1000, 0, 0xffffff00));
+  CHECK(cache.get(POLL_OBD_PID, 0, 0x0C, 0x100, reply));
+  CHECK_EQ(reply.age, 0x200);
+
+  // CACHE_IGNITION replies are dropped when the ignition state changes, others are kept
+  cache.setIgnition(true);
+  CHECK(cache.put(POLL_UDS_DID, 0x7E4, 0x220105, 0, soh, sizeof(soh), 3600000, CACHE_IGNITION, 10000));
+  CHECK(cache.put(POLL_UDS_DID, 0x7C6, 0x22B002, 0, soh, sizeof(soh), 3600000, 0, 10000));
+  cache.setIgnition(true);
+  CHECK(cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 11000, reply));
+  cache.setIgnition(false);
+  CHECK(!cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 11000, reply));
+  CHECK_EQ(cache.remaining(POLL_UDS_DID, 0x7E4, 0x220105, 11000), 0);
+  CHECK(cache.get(POLL_UDS_DID, 0x7C6, 0x22B002, 11000, reply));
+  // ... and a reply read after the change is valid again
+  CHECK(cache.put(POLL_UDS_DID, 0x7E4, 0x220105, 0, soh, sizeof(soh), 3600000, CACHE_IGNITION, 12000));
+  CHECK(cache.get(POLL_UDS_DID, 0x7E4, 0x220105, 12000, reply));
+
+  // at() lists the valid replies only
+  int listed = 0;
+  for (uint8_t i = 0; i < CACHE_MAX_ENTRIES; i++) {
+    if (cache.at(i, 12000, reply)) listed++;
+  }
+  CHECK_EQ(listed, 2);
+
+  // replies longer than CACHE_MAX_DATA are not cached
+  uint8_t big[CACHE_MAX_DATA + 1] = {0x62};
+  CHECK(!cache.put(POLL_UDS_DID, 0x7E4, 0x220101, 0, big, sizeof(big), 1000, 0, 12000));
+  CHECK(cache.put(POLL_UDS_DID, 0x7E4, 0x220101, 0, big, CACHE_MAX_DATA, 1000, 0, 12000));
+  CHECK(cache.get(POLL_UDS_DID, 0x7E4, 0x220101, 12000, reply));
+  CHECK_EQ(reply.len, CACHE_MAX_DATA);
+
+  // a full cache replaces the reply read longest ago
+  for (uint32_t pid = 0x20; cache.count() < CACHE_MAX_ENTRIES; pid++) {
+    CHECK(cache.put(POLL_OBD_PID, 0, pid, pid, 0, 0, 60000, 0, 20000 + pid));
+  }
+  CHECK(cache.put(POLL_OBD_PID, 0, 0x0F, 15, 0, 0, 60000, 0, 30000));
+  CHECK_EQ(cache.count(), CACHE_MAX_ENTRIES);
+  CHECK(cache.get(POLL_OBD_PID, 0, 0x0F, 30000, reply));
+  // the 0x0C reply was stamped before the wrap, so it is the oldest
+  CHECK(!cache.get(POLL_OBD_PID, 0, 0x0C, 30000, reply));
+  CHECK(cache.get(POLL_OBD_PID, 0, 0x0D, 9000, reply));
+  return checkResult("test_response_cache");
+}
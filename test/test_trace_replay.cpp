@@ -0,0 +1,169 @@
+/*************************************************************************
+* Adapter trace recording (CTraceLink) and replay (CReplayLink) driving
+* COBD, readUDS_DID and the signal decoder on the host
+*
+*   test_trace_replay [cycles]      record, verify and benchmark a replay
+*************************************************************************/
+
+#include <chrono>
+#include <map>
+#include <string>
+#include <vector>
+#include <FreematicsPlus.h>
+#include "CAN-uds.h"
+#include "CAN-data.h"
+#include "check.h"
+
+// as in telelogger.cpp, waiting for a reply only yields; replay has nothing to wait for
+class CReplayOBD : public COBD
+{
+protected:
+  void idleTasks() {}
+};
+
+CReplayOBD obd;
+
+// simulated adapter answering by command; AT commands get OK, unknown requests NO DATA
+class CMockAdapter : public CLink {
+public:
+  int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+  {
+    send(cmd);
+    return receive(buf, bufsize, timeout);
+  }
+  bool send(const char* str)
+  {
+    m_last = str;
+    return true;
+  }
+  int receive(char* buffer, int bufsize, unsigned int timeout)
+  {
+    std::map<std::string, std::string>::const_iterator it = replies.find(m_last);
+    std::string reply = it != replies.end() ? it->second : (m_last.compare(0, 2, "AT") ? "NO DATA\r" : "OK\r");
+    if (it == replies.end() && m_last.compare(0, 2, "AT")) unknown.push_back(m_last);
+    if (latency) delay(latency);
+    int len = snprintf(buffer, bufsize, "%s", reply.c_str());
+    return len < bufsize ? len : bufsize - 1;
+  }
+  int read()
+  {
+    return m_pending < (int)pending.size() ? pending[m_pending++] : -1;
+  }
+  std::map<std::string, std::string> replies;
+  std::vector<std::string> unknown;
+  std::string pending;
+  unsigned int latency = 0;
+private:
+  std::string m_last;
+  int m_pending = 0;
+};
+
+// collects the trace in memory instead of an SD file
+class CMemoryPrint : public Print {
+public:
+  size_t write(uint8_t c)
+  {
+    data.push_back(c);
+    return 1;
+  }
+  size_t write(const uint8_t* buf, size_t len)
+  {
+    data.insert(data.end(), buf, buf + len);
+    return len;
+  }
+  std::vector<uint8_t> data;
+};
+
+// one acquisition cycle as in process(): a multi-PID request and a BMS DID decoded into telemetry
+static int acquire(AbrpTelemetry& telemetry)
+{
+  static const byte pids[] = {PID_SPEED, PID_RPM, PID_THROTTLE};
+  int values[3];
+  bool success[3];
+  int samples = obd.readPID(pids, 3, values, success);
+  if (success[0]) telemetry.speed = values[0];
+  uint8_t buf[UDS_BUFFER_SIZE];
+  int len = readUDS_DID(0x7E4, 0x220101, buf, sizeof(buf));
+  if (len) samples += decodeAbrpTelemetry(0x7E4, 0x220101, buf, len, telemetry);
+  return samples;
+}
+
+int main(int argc, char** argv)
+{
+  int cycles = argc > 1 ? atoi(argv[1]) : 1000;
+
+  CMockAdapter adapter;
+  adapter.replies["010D0C11\r"] = "41 0D 32 0C 0B B8 11 20\r";
+  adapter.replies["220101\r"] = "014\r0: 62 01 01 FF F7 E7\r1: FF A0 00 00 00 00 A0\r2: FF 9C 0F A0 14 12 13\r";
+  adapter.pending = "STOPPED\r";
+
+  // record two cycles and some unsolicited bytes drained with read()
+  CMemoryPrint out;
+  CTraceLink trace;
+  trace.wrap(&adapter);
+  trace.attach(&out);
+  obd.begin(&trace);
+  AbrpTelemetry recorded;
+  int recordedSamples = acquire(recorded);
+  while (trace.read() >= 0);
+  adapter.latency = 10;
+  recordedSamples += acquire(recorded);
+  trace.flush();
+  for (size_t i = 0; i < adapter.unknown.size(); i++) printf("unexpected request %s\n", adapter.unknown[i].c_str());
+  CHECK(adapter.unknown.empty());
+  CHECK_EQ(recordedSamples, 2 * (3 + 6));
+  CHECK(recorded.soc_valid && recorded.power_valid);
+  CHECK_EQ(out.data.size(), trace.size());
+  CHECK(out.data.size() > 4 && !memcmp(out.data.data(), TRACE_MAGIC, 4));
+
+  // replay: identical requests, identical results, unsolicited bytes back through read()
+  CReplayLink replay;
+  CHECK(!replay.load((const byte*)"FTR0", 4));
+  CHECK(replay.load(out.data.data(), out.data.size()));
+  obd = CReplayOBD();
+  obd.begin(&replay);
+  AbrpTelemetry replayed;
+  int replayedSamples = acquire(replayed);
+  std::string drained;
+  for (int c; (c = replay.read()) >= 0; ) drained += (char)c;
+  CHECK(drained == adapter.pending);
+  // real-time mode waits the recorded 10 ms reply latency
+  replay.load(out.data.data(), out.data.size(), true);
+  obd = CReplayOBD();
+  obd.begin(&replay);
+  replayedSamples = acquire(replayed);
+  while (replay.read() >= 0);
+  uint32_t start = millis();
+  replayedSamples += acquire(replayed);
+  CHECK(millis() - start >= 18);
+  CHECK_EQ(replayedSamples, recordedSamples);
+  CHECK(replay.done());
+  CHECK_EQ(replay.mismatches(), 0);
+  CHECK(replayed.speed == recorded.speed && replayed.soc == recorded.soc && replayed.power == recorded.power);
+
+  // a request the trace does not expect is counted, replay stays aligned with the recording
+  replay.load(out.data.data(), out.data.size());
+  char buf[64];
+  CHECK(replay.sendCommand("ATX\r", buf, sizeof(buf), 0) > 0);
+  CHECK_EQ(replay.mismatches(), 1);
+  CHECK_EQ(replay.records(), 2);
+
+  // benchmark: replay the recorded cycles as fast as they parse
+  typedef std::chrono::steady_clock clock;
+  long long samples = 0;
+  clock::time_point t0 = clock::now();
+  for (int i = 0; i < cycles; i++) {
+    replay.load(out.data.data(), out.data.size());
+    obd = CReplayOBD();
+    obd.begin(&replay);
+    AbrpTelemetry telemetry;
+    samples += acquire(telemetry);
+    while (replay.read() >= 0);
+    samples += acquire(telemetry);
+  }
+  double us = std::chrono::duration<double, std::micro>(clock::now() - t0).count();
+  CHECK_EQ(samples, (long long)cycles * recordedSamples);
+  printf("replayed %d traces of %u bytes: %.1f us per acquisition cycle, %.0f samples/s\n",
+    cycles, (unsigned)out.data.size(), us / (cycles * 2), samples * 1e6 / us);
+  return checkResult("test_trace_replay");
+}
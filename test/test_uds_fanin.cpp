@@ -0,0 +1,102 @@
+/*************************************************************************
+* Functional UDS reads answered by several ECUs at once (readUDS_DIDAll)
+* with 11-bit and 29-bit headers, interleaved multi-frame replies and
+* negative responses, against a simulated adapter
+*************************************************************************/
+
+#include <map>
+#include <string>
+#include <FreematicsPlus.h>
+#include "CAN-uds.h"
+#include "check.h"
+
+COBD obd;
+
+// simulated adapter answering by command; AT commands get OK, unknown requests NO DATA
+class CMockAdapter : public CLink {
+public:
+  int sendCommand(const char* cmd, char* buf, int bufsize, unsigned int timeout)
+  {
+    log += cmd;
+    std::map<std::string, std::string>::const_iterator it = replies.find(cmd);
+    std::string reply = it != replies.end() ? it->second : (strncmp(cmd, "AT", 2) ? "NO DATA\r" : "OK\r");
+    int len = snprintf(buf, bufsize, "%s", reply.c_str());
+    return len < bufsize ? len : bufsize - 1;
+  }
+  std::map<std::string, std::string> replies;
+  std::string log;
+};
+
+static const char vin[] = "KNAGM4AD1P5012345";
+
+// checks a positive VIN reply (62 F1 90 + 17 characters)
+static bool isVin(const UdsEcuResponse& r)
+{
+  return r.nrc == 0 && r.len == 20 && r.data[0] == 0x62 && r.data[1] == 0xF1 && r.data[2] == 0x90 &&
+    !memcmp(r.data + 3, vin, 17);
+}
+
+int main()
+{
+  CMockAdapter adapter;
+  obd.begin(&adapter);
+  uint8_t buf[256];
+  UdsEcuResponse ecus[UDS_MAX_ECUS];
+
+  // 11-bit: two ECUs interleave their multi-frame VIN, one rejects the DID,
+  // one stops after its first frame and one line is adapter noise
+  adapter.replies["22F190\r"] =
+    "7E8 10 14 62 F1 90 4B 4E 41\r"
+    "7EA 10 14 62 F1 90 4B 4E 41\r"
+    "7E8 21 47 4D 34 41 44 31 50\r"
+    "7EC 03 7F 22 31 AA AA AA AA\r"
+    "7EA 21 47 4D 34 41 44 31 50\r"
+    "7EB 10 14 62 F1 90 4B 4E 41\r"
+    "7E8 22 35 30 31 32 33 34 35\r"
+    "CAN ERROR\r"
+    "7EA 22 35 30 31 32 33 34 35\r\r>";
+  int n = readUDS_DIDAll(UDS_FUNCTIONAL_ID, 0x22F190, buf, sizeof(buf), ecus, UDS_MAX_ECUS);
+  CHECK_EQ(n, 3);
+  CHECK_EQ(ecus[0].canId, 0x7E8);
+  CHECK(isVin(ecus[0]));
+  CHECK_EQ(ecus[1].canId, 0x7EA);
+  CHECK(isVin(ecus[1]));
+  CHECK_EQ(ecus[2].canId, 0x7EC);
+  CHECK_EQ(ecus[2].len, 0);
+  CHECK_EQ(ecus[2].nrc, UDS_NRC_REQUEST_OUT_OF_RANGE);
+  CHECK(adapter.log.find("ATH1\rATSH 7DF\rATCM 7F8\rATCF 7E8\r22F190\rATH0\r") != std::string::npos);
+
+  // 29-bit: the adapter prints the ID as four byte pairs with spaces on, as one token with ATS0
+  adapter.log.clear();
+  adapter.replies["22F190\r"] =
+    "18 DA F1 10 10 14 62 F1 90 4B 4E 41\r"
+    "18 DA F1 11 03 7F 22 11 AA AA AA AA\r"
+    "18 DA F1 10 21 47 4D 34 41 44 31 50\r"
+    "18DAF117 10 14 62 F1 90 4B 4E 41\r"
+    "18 DA F1 10 22 35 30 31 32 33 34 35\r"
+    "18DAF117 21 47 4D 34 41 44 31 50\r"
+    "18DAF117 22 35 30 31 32 33 34 35\r\r>";
+  n = readUDS_DIDAll(UDS_FUNCTIONAL_ID_29, 0x22F190, buf, sizeof(buf), ecus, UDS_MAX_ECUS);
+  CHECK_EQ(n, 3);
+  CHECK_EQ(ecus[0].canId, 0x18DAF110);
+  CHECK(isVin(ecus[0]));
+  CHECK_EQ(ecus[1].canId, 0x18DAF111);
+  CHECK_EQ(ecus[1].nrc, UDS_NRC_SERVICE_NOT_SUPPORTED);
+  CHECK_EQ(ecus[2].canId, 0x18DAF117);
+  CHECK(isVin(ecus[2]));
+  CHECK(adapter.log.find("ATCM 1FFFFF00\rATCF 18DAF100\r") != std::string::npos);
+
+  // ECUs beyond maxEcus, or whose reply does not fit buf, are left out
+  n = readUDS_DIDAll(UDS_FUNCTIONAL_ID_29, 0x22F190, buf, sizeof(buf), ecus, 1);
+  CHECK_EQ(n, 1);
+  CHECK_EQ(ecus[0].canId, 0x18DAF110);
+  n = readUDS_DIDAll(UDS_FUNCTIONAL_ID_29, 0x22F190, buf, 24, ecus, UDS_MAX_ECUS);
+  CHECK_EQ(n, 2);
+  CHECK(isVin(ecus[0]));
+  CHECK_EQ(ecus[1].nrc, UDS_NRC_SERVICE_NOT_SUPPORTED);
+
+  // nobody answering
+  adapter.replies.clear();
+  CHECK_EQ(readUDS_DIDAll(UDS_FUNCTIONAL_ID, 0x22F190, buf, sizeof(buf), ecus, UDS_MAX_ECUS), 0);
+  return checkResult("test_uds_fanin");
+}